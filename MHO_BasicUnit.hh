@@ -0,0 +1,185 @@
+#ifndef MHO_BasicUnit_HH__
+#define MHO_BasicUnit_HH__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "MHO_Unit.hh"
+
+
+namespace hops
+{
+
+    //
+    // Packed unit: N exponents of the signed integer type ExpT held as
+    // lanes of 64-bit words (SWAR, SIMD within a register). The default,
+    // MHO_PackedUnit, is NMEAS int8_t exponents in 16 bytes, instead of
+    // the 48 bytes of the int array in MHO_Unit.
+    //
+    // Multiplication and division are one lane-wise add or subtract per
+    // word, with the carries kept from crossing lane boundaries, and the
+    // signed overflow of any lane is detected from the sign bits (it
+    // throws std::overflow_error). Equality compares whole words. The
+    // unused lanes of the last word are always zero.
+    //
+    template <std::size_t N = NMEAS, typename ExpT = int8_t>
+    class MHO_BasicUnit
+    {
+        static_assert(std::is_integral<ExpT>::value &&
+                      std::is_signed<ExpT>::value &&
+                      sizeof(ExpT) <= 4,
+                      "ExpT must be a signed integer of at most 32 bits");
+
+    public:
+
+        static constexpr std::size_t kBits = 8*sizeof(ExpT);
+        static constexpr std::size_t kLanes = 64/kBits;  // Per word
+        static constexpr std::size_t kWords = (N + kLanes - 1)/kLanes;
+
+        MHO_BasicUnit(): fWord{} {};
+
+        explicit MHO_BasicUnit(const std::array<int, N>& exp): fWord{} {
+            for (std::size_t mu=0; mu<N; mu++) {
+                if (exp[mu] < std::numeric_limits<ExpT>::min() ||
+                    exp[mu] > std::numeric_limits<ExpT>::max())
+                    throw std::overflow_error(
+                        "MHO_BasicUnit: exponent out of the lane range");
+                SetLane(mu, exp[mu]);
+            }
+        }
+
+        template <std::size_t M = N,
+                  typename = typename std::enable_if<M == NMEAS>::type>
+        explicit MHO_BasicUnit(const MHO_Unit& unit):
+            MHO_BasicUnit(unit.GetUnitExp()) {};
+
+        template <std::size_t M = N,
+                  typename = typename std::enable_if<M == NMEAS>::type>
+        explicit operator MHO_Unit() const { return MHO_Unit(GetUnitExp()); }
+
+        std::array<int, N> GetUnitExp() const {
+            std::array<int, N> exp;
+            for (std::size_t mu=0; mu<N; mu++) exp[mu] = GetLane(mu);
+            return exp;
+        }
+
+        std::string GetUnitString() const {
+            return MHO_Unit(GetUnitExp()).GetUnitString();
+        }
+
+        int GetLane(std::size_t mu) const {
+            uint64_t lane = (fWord[mu/kLanes] >> Shift(mu)) & kLaneMask;
+            return (int) (ExpT) lane;  // Sign-extend
+        }
+
+        MHO_BasicUnit operator*(const MHO_BasicUnit& other) const {
+            MHO_BasicUnit unit;
+            uint64_t ovf = 0;
+            for (std::size_t w=0; w<kWords; w++)
+                unit.fWord[w] = Add(fWord[w], other.fWord[w], ovf);
+            if (ovf) Overflow();
+            return unit;
+        }
+
+        MHO_BasicUnit operator/(const MHO_BasicUnit& other) const {
+            MHO_BasicUnit unit;
+            uint64_t ovf = 0;
+            for (std::size_t w=0; w<kWords; w++)
+                unit.fWord[w] = Sub(fWord[w], other.fWord[w], ovf);
+            if (ovf) Overflow();
+            return unit;
+        }
+
+        MHO_BasicUnit& operator*=(const MHO_BasicUnit& other) {
+            return *this = *this * other;
+        }
+
+        MHO_BasicUnit& operator/=(const MHO_BasicUnit& other) {
+            return *this = *this / other;
+        }
+
+        // No SWAR multiply: lane by lane, in int, checked for overflow
+        // there and then for the lane range
+        MHO_BasicUnit operator^(int power) const {
+            std::array<int, N> exp = GetUnitExp();
+            for (std::size_t mu=0; mu<N; mu++)
+                if (__builtin_mul_overflow(exp[mu], power, &exp[mu]))
+                    Overflow();
+            return MHO_BasicUnit(exp);
+        }
+
+        MHO_BasicUnit& operator^=(int power) {
+            return *this = *this ^ power;
+        }
+
+        void RaiseToPower(int power) { *this ^= power; }
+
+        void Invert() { *this = MHO_BasicUnit() / *this; }
+
+        bool operator==(const MHO_BasicUnit& other) const {
+            bool eq = true;
+            for (std::size_t w=0; w<kWords; w++)
+                eq &= (fWord[w] == other.fWord[w]);
+            return eq;
+        }
+
+        bool operator!=(const MHO_BasicUnit& other) const {
+            return !(*this == other);
+        }
+
+    private:
+
+        std::array<uint64_t, kWords> fWord;
+
+        static constexpr uint64_t kLaneMask =
+            (kBits == 64) ? ~0ULL : ((1ULL << kBits) - 1);
+
+        // The sign bit of every lane
+        static constexpr uint64_t kHigh =
+            ~0ULL / kLaneMask * (1ULL << (kBits - 1));
+
+        static std::size_t Shift(std::size_t mu) { return (mu%kLanes)*kBits; }
+
+        void SetLane(std::size_t mu, int exp) {
+            uint64_t& word = fWord[mu/kLanes];
+            word &= ~(kLaneMask << Shift(mu));
+            word |= ((uint64_t) exp & kLaneMask) << Shift(mu);
+        }
+
+        //
+        // Lane-wise a + b: add the lanes without their sign bits, so no
+        // carry leaves a lane, then put the sign bits back with xor.
+        // A lane overflows if a and b have the same sign and the sum has
+        // the other one.
+        //
+        static uint64_t Add(uint64_t a, uint64_t b, uint64_t& ovf) {
+            uint64_t sum = ((a & ~kHigh) + (b & ~kHigh)) ^ ((a ^ b) & kHigh);
+            ovf |= ~(a ^ b) & (a ^ sum) & kHigh;
+            return sum;
+        }
+
+        //
+        // Lane-wise a - b: set the sign bits of a, so no borrow leaves
+        // a lane, then fix them with xor. A lane overflows if a and b have
+        // different signs and the difference has the sign of b.
+        //
+        static uint64_t Sub(uint64_t a, uint64_t b, uint64_t& ovf) {
+            uint64_t dif = ((a | kHigh) - (b & ~kHigh)) ^ (~(a ^ b) & kHigh);
+            ovf |= (a ^ b) & (a ^ dif) & kHigh;
+            return dif;
+        }
+
+        [[noreturn]] static void Overflow() {
+            throw std::overflow_error("MHO_BasicUnit: exponent overflow");
+        }
+    };
+
+    typedef MHO_BasicUnit<NMEAS, int8_t> MHO_PackedUnit;
+
+}
+
+#endif /* end of include guard: MHO_BasicUnit_HH__ */
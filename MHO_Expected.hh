@@ -0,0 +1,61 @@
+#ifndef MHO_Expected_HH__
+#define MHO_Expected_HH__
+
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+
+namespace hops
+{
+
+    // The error of a failed MHO_Expected, as std::unexpected
+    template <typename E>
+    struct MHO_Unexpected
+    {
+        E fError;
+        constexpr explicit MHO_Unexpected(const E& err): fError(err) {};
+    };
+
+    //
+    // A value of type T or an error of type E: the subset of C++23's
+    // std::expected used here, with the same names, so that it can be
+    // replaced with std::expected once the compilers have it. Nothing
+    // throws: operator* and error() must only be called on the right
+    // alternative. No heap is used.
+    //
+    template <typename T, typename E>
+    class MHO_Expected
+    {
+    public:
+
+        MHO_Expected(const T& value): fData(std::in_place_index<0>, value) {};
+        MHO_Expected(T&& value):
+            fData(std::in_place_index<0>, std::move(value)) {};
+        MHO_Expected(const MHO_Unexpected<E>& err):
+            fData(std::in_place_index<1>, err.fError) {};
+
+        bool has_value() const { return fData.index() == 0; }
+        explicit operator bool() const { return has_value(); }
+
+        const T& operator*() const { return *std::get_if<0>(&fData); }
+        T& operator*() { return *std::get_if<0>(&fData); }
+        const T* operator->() const { return std::get_if<0>(&fData); }
+        T* operator->() { return std::get_if<0>(&fData); }
+
+        const E& error() const { return *std::get_if<1>(&fData); }
+
+        template <typename U>
+        T value_or(U&& other) const {
+            return has_value() ? **this
+                               : static_cast<T>(std::forward<U>(other));
+        }
+
+    private:
+
+        std::variant<T, E> fData;
+    };
+
+}
+
+#endif /* end of include guard: MHO_Expected_HH__ */
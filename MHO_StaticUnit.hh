@@ -0,0 +1,95 @@
+#ifndef MHO_StaticUnit_HH__
+#define MHO_StaticUnit_HH__
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "MHO_Unit.hh"
+
+
+namespace hops
+{
+
+    //
+    // A unit whose NMEAS exponents are template parameters, in the order
+    // of meas_tab. The objects are empty: multiplication, division and
+    // exponentiation are done by the compiler on the types, and a result
+    // of the wrong dimension does not compile. Conversions to and from
+    // the run-time MHO_Unit are explicit; the one from MHO_Unit checks
+    // the exponents and throws std::invalid_argument on mismatch.
+    //
+    //     MHO_StaticUnitOf<"m/s^2"> acc;
+    //     MHO_StaticUnitOf<"kg*m/s^2"> F = MHO_StaticUnitOf<"kg">() * acc;
+    //     auto acc2 = acc ^ MHO_Pow<2>();
+    //
+    template <int... E>
+    class MHO_StaticUnit
+    {
+        static_assert(sizeof...(E) == NMEAS,
+                      "MHO_StaticUnit needs exactly NMEAS exponents");
+
+    public:
+
+        static constexpr std::array<int, NMEAS> kExp = {E...};
+
+        constexpr MHO_StaticUnit() {};
+
+        explicit MHO_StaticUnit(const MHO_Unit& unit) {
+            if (!Matches(unit))
+                throw std::invalid_argument(
+                    "MHO_StaticUnit: unit '" + unit.GetUnitString()
+                    + "' has wrong dimension, expected '"
+                    + MHO_Unit(kExp).GetUnitString() + "'");
+        }
+
+        explicit operator MHO_Unit() const { return MHO_Unit(kExp); }
+
+        static constexpr std::array<int, NMEAS> GetUnitExp() { return kExp; }
+        static std::string GetUnitString() {
+            return MHO_Unit(kExp).GetUnitString();
+        }
+
+        // Run-time check at an API boundary
+        static bool Matches(const MHO_Unit& unit) {
+            return unit.GetUnitExp() == kExp;
+        }
+    };
+
+    // Compile-time integer power for MHO_StaticUnit: unit ^ MHO_Pow<2>()
+    template <int P>
+    using MHO_Pow = std::integral_constant<int, P>;
+
+    template <int... A, int... B>
+    constexpr MHO_StaticUnit<(A + B)...>
+    operator*(MHO_StaticUnit<A...>, MHO_StaticUnit<B...>) { return {}; }
+
+    template <int... A, int... B>
+    constexpr MHO_StaticUnit<(A - B)...>
+    operator/(MHO_StaticUnit<A...>, MHO_StaticUnit<B...>) { return {}; }
+
+    template <int... E, int P>
+    constexpr MHO_StaticUnit<(P * E)...>
+    operator^(MHO_StaticUnit<E...>, MHO_Pow<P>) { return {}; }
+
+    // Only the units of the same dimension can be compared
+    template <int... E>
+    constexpr bool operator==(MHO_StaticUnit<E...>, MHO_StaticUnit<E...>) {
+        return true;
+    }
+
+    namespace static_unit_detail
+    {
+        template <std::array<int, NMEAS> Exp, std::size_t... I>
+        MHO_StaticUnit<Exp[I]...> Make(std::index_sequence<I...>);
+    }
+
+    // The MHO_StaticUnit type of a unit expression, parsed at compile time
+    template <unit_literals::MHO_UnitString S>
+    using MHO_StaticUnitOf = decltype(static_unit_detail::Make<
+        unit_literals::UnitLiteralExp<S>()>(std::make_index_sequence<NMEAS>()));
+
+}
+
+#endif /* end of include guard: MHO_StaticUnit_HH__ */
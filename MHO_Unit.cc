@@ -1,39 +1,108 @@
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include "MHO_Unit.hh"
-#include "read_units.lex.h"
+#include "MHO_UnitCache.hh"
+#include "MHO_UnitRegistry.hh"
+#include "MHO_WorkStealing.hh"
 #include "read_units.tab.h"
+#include "read_units.lex.h"
 
 
 namespace hops 
 {
-    
-    MHO_Unit::MHO_Unit() : fStringRep("") {
-        for (int mu=0; mu<NMEAS; mu++) this->fExp[mu] = 0;
+
+    namespace
+    {
+        //
+        // Long-lived parser state of a thread: the scanner is created
+        // once and reused by all the parses in the thread. The parser
+        // runs in the direct mode, so it builds no AST and no list.
+        //
+        struct ParserState {
+            yyscan_t fScanner;
+            std::vector<char> fText;  // The input, as Flex wants it
+            ParserState() : fScanner(0) {
+                if (yylex_init(&fScanner)) fScanner = 0;
+            }
+            ~ParserState() {
+                if (fScanner) yylex_destroy(fScanner);
+            }
+        };
+
+        thread_local ParserState tParser;
+
+        std::atomic<int> gEngine(MHO_Unit::kFlexBison);
     }
 
-    MHO_Unit::MHO_Unit(const std::string& unit) : fExp{} {
-        MHO_Unit::Parse(unit);
+    void MHO_Unit::SetEngine(Engine engine) {
+        gEngine.store(engine, std::memory_order_relaxed);
+    }
+
+    MHO_Unit::Engine MHO_Unit::GetEngine() {
+        return (Engine) gEngine.load(std::memory_order_relaxed);
     }
     
     //
-    // Operator overloads for multiplication, division, and exponentiation
+    // Batch parsing: the strings are split into chunks, which the
+    // workers share out by work stealing (MHO_ParallelFor), so a few
+    // slow strings do not hold up the others. Every string is parsed in
+    // place by MHO_UnitParser, skipping illegal characters like Flex,
+    // with the symbols looked up in the MHO_UnitRegistry.
     //
-    MHO_Unit MHO_Unit::operator*(const MHO_Unit& other) const {
-        MHO_Unit unit;
-        for (int mu=0; mu<NMEAS; mu++)
-            unit.fExp[mu] = this->fExp[mu] + other.fExp[mu];
-        return unit;
+    std::size_t MHO_Unit::ParseMany(std::span<const std::string_view> units,
+                                    std::span<std::array<int, NMEAS> > exps,
+                                    std::span<MHO_UnitParser::Error> errors,
+                                    unsigned nthreads) {
+        const std::size_t kChunk = 256;  // Strings per chunk
+        std::size_t n = std::min(units.size(), exps.size());
+        bool report = !errors.empty();
+        if (report) n = std::min(n, errors.size());
+        std::atomic<std::size_t> nbad(0);
+        const MHO_UnitRegistry& registry = MHO_UnitRegistry::GetInstance();
+
+        MHO_ParallelFor(n, kChunk, nthreads,
+                        [&](std::size_t begin, std::size_t end) {
+            std::size_t bad = 0;
+            for (std::size_t i=begin; i<end; i++) {
+                MHO_UnitParser parser(units[i], true);
+                parser.SetLookup(MHO_UnitRegistry::LookupFn, &registry);
+                MHO_UnitParser::Result res = parser.Parse();
+                exps[i] = res.fExp;
+                if (report) errors[i] = res.fError;
+                bad += !res.Ok();
+            }
+            nbad.fetch_add(bad, std::memory_order_relaxed);
+        });
+
+        return nbad.load();
+    }
+    
+    MHO_Expected<MHO_Unit, MHO_Unit::ParseError>
+    MHO_Unit::TryParse(std::string_view unit) {
+        MHO_UnitParser parser(unit);
+        parser.SetLookup(MHO_UnitRegistry::LookupFn,
+                         &MHO_UnitRegistry::GetInstance());
+        MHO_UnitParser::Result res = parser.Parse();
+        if (!res.Ok())
+            return MHO_Unexpected<ParseError>({res.fError, res.fOffset});
+        return MHO_Unit(res.fExp);
     }
 
-    MHO_Unit MHO_Unit::operator/(const MHO_Unit& other) const {
-        MHO_Unit unit;
-        for (int mu=0; mu<NMEAS; mu++)
-            unit.fExp[mu] = this->fExp[mu] - other.fExp[mu];
-        return unit;
+    MHO_Unit::MHO_Unit(const std::string& unit) : fExp{} {
+        MHO_Unit::Parse(unit);
     }
 
+    MHO_Unit::MHO_Unit(std::string_view unit) : fExp{} {
+        MHO_Unit::Parse(unit);
+    }
+    
     //
     // Operator overloads for multiplication by a string literal
     //
@@ -95,287 +164,116 @@ namespace hops
     }
         
     //
-    // Operator overloads for compound assignment
-    //
-    MHO_Unit& MHO_Unit::operator*=(const MHO_Unit& other) {
-        for (int mu=0; mu<NMEAS; mu++)
-            this->fExp[mu] += other.fExp[mu];
-        return *this;
-    }
-    
-    MHO_Unit& MHO_Unit::operator/=(const MHO_Unit& other) {
-        for (int mu=0; mu<NMEAS; mu++)
-            this->fExp[mu] -= other.fExp[mu];
-        return *this;
-    }
-    
-    //  
-    // Raise the unit to an integer power
-    //
-    void MHO_Unit::RaiseToPower(int power) {
-        for (int mu=0; mu<NMEAS; mu++)
-            this->fExp[mu] = power*this->fExp[mu];
-    }
-    
-    //  
-    // Yet another raise the unit to an integer power: unit^power
-    // with its compound counterpart
-    //
-    MHO_Unit MHO_Unit::operator^(int power) {
-        MHO_Unit unit;
-        for (int mu=0; mu<NMEAS; mu++)
-            unit.fExp[mu] = power * this->fExp[mu];
-        return unit;        
-    }
-
-    MHO_Unit MHO_Unit::operator^=(int power) {
-        for (int mu=0; mu<NMEAS; mu++)
-            this->fExp[mu] *= power;
-        return *this;        
-    }
-
-
-
-    //
-    // Invert the unit:
+    // Parse() takes a string and determines the appropriate
+    // unit exponents, and sets them in fExp
     //
-    void  MHO_Unit::Invert() {
-        for (int mu=0; mu<NMEAS; mu++)
-            this->fExp[mu] = -this->fExp[mu];
-    }
-
+    // The scanner and the parser are reentrant: all their state is in the
+    // thread's scanner object and the local parse context, so any number
+    // of threads may parse concurrently without locking.
     //
-    // Equality operator
+    // If the MHO_UnitCache is enabled, it is looked up first, and
+    // the successfully parsed strings are added to it.
     //
-    bool MHO_Unit::operator==(const MHO_Unit& other) const {
-        return (bool *) (this->fExp == other.fExp);
-    }
-    
+    // With the kHandWritten engine, the string is parsed in place by
+    // MHO_UnitParser, skipping illegal characters like the Flex scanner.
     //
-    // Inequality operator
+    // Either engine takes the unit symbols from the MHO_UnitRegistry, so
+    // the units registered at run time are understood as well.
     //
-    bool MHO_Unit::operator!=(const MHO_Unit& other) const {
-        return (bool *) (this->fExp != other.fExp);
-    }
-    
-    //    
-    // Assignment operator
+    // The string is not copied, except for Flex: the scanner writes into
+    // its buffer, which must end in two nulls. So the text is copied into
+    // the thread's buffer, whose storage is kept from parse to parse, and
+    // scanned there by yy_scan_buffer(). As with yy_scan_string() before,
+    // Flex sees the text up to the first null only.
     //
-    MHO_Unit& MHO_Unit::operator=(const MHO_Unit& other) {
-        this->fExp = other.fExp;
-        return *this;
-    }
+    void MHO_Unit::Parse(std::string_view repl) {
+        bool cache = MHO_UnitCache::IsEnabled();
+        if (cache && MHO_UnitCache::Lookup(repl, fExp)) return;
+
+        const MHO_UnitRegistry& registry = MHO_UnitRegistry::GetInstance();
+
+        if (GetEngine() == kHandWritten) {
+            MHO_UnitParser parser(repl, true);
+            parser.SetLookup(MHO_UnitRegistry::LookupFn, &registry);
+            MHO_UnitParser::Result res = parser.Parse();
+            if (res.Ok()) {
+                fExp = res.fExp;
+                if (cache) MHO_UnitCache::Insert(repl, fExp);
+            }
+            else
+                fprintf(stderr, "Error: %s at offset %zu.\n",
+                        MHO_UnitParser::ErrorString(res.fError), res.fOffset);
+            return;
+        }
 
-    
-    //
-    // Parse() takes a string and determines the appropriate
-    // unit exponents, and sets them in fExp
-    //
-    void MHO_Unit::Parse(const std::string& repl) {
-        char *meas_exp = (char *) repl.std::string::c_str();
+        ParserState& ps = tParser;
+        yyscan_t scanner = ps.fScanner;
         YY_BUFFER_STATE buf;
-        expr_list *el; 
-        meas_pow mpow;  // A structure with int exp[NMEAS]; reflecting fExp.
+        parse_ctx ctx = {};  // Per-call context; ctx.mpow gets the powers
         int mu, perr;
 
-        buf = yy_scan_string(meas_exp);
+        if (!scanner) return;
+        ctx.direct = 1;
+        ctx.lookup = MHO_UnitRegistry::LookupC;
+        ctx.registry = &registry;
+        std::string_view text = repl.substr(0, repl.find('\0'));
+        ps.fText.assign(text.begin(), text.end());
+        ps.fText.insert(ps.fText.end(), 2, '\0');  // YY_END_OF_BUFFER_CHARs
+        buf = yy_scan_buffer(ps.fText.data(), ps.fText.size(), scanner);
+        if (!buf) return;
         
-        perr = yyparse(&el);  /* Sets el to point at the linked list */
+        perr = yyparse(scanner, &ctx); /* Sets ctx.mpow.exp to the powers */
 
         if (perr == 0) {
-            // Convert list of measures to array of their powers
-            explst_to_arr_and_free(el, &mpow); 
-            for (mu=0; mu<NMEAS; mu++) fExp[mu] = mpow.exp[mu];
+            for (mu=0; mu<NMEAS; mu++) fExp[mu] = ctx.mpow.exp[mu];
+            if (cache) MHO_UnitCache::Insert(repl, fExp);
         }
         
-        yy_delete_buffer(buf);
+        yy_delete_buffer(buf, scanner);
         
-    }       // End MHO_Unit::Parse(const std::string& repl)
+    }       // End MHO_Unit::Parse(std::string_view repl)
 
     
     //
-    // Construct a human-readable string from the base unit exponents
+    // Write a human-readable string of the base unit exponents
     //
     // In the loop over the NMEAS available measurement units, the exponent
     // array member, fExp, is checked for non-zero exponent. The its position,
-    // mu, is used to fetch the corresponding unit from the meas_tab where
-    // the units are stored as c-style char arrays. The *char unit is converted
-    // into std::string meastr, which is appended to the meas_expr string.
-    // The units in meas_expr are altered with the asterisk.
+    // mu, is used to fetch the corresponding base unit symbol from the
+    // kMeasTab, whose lengths are known at compile time. It is copied to
+    // the buffer, followed by the exponent if it is not 1. The units are
+    // separated by " * ".
     //
-    std::string MHO_Unit::ConstructString() const {
-        std::string mexpr; // Measure expression string to work on
-        std::string meas_expr; // Measure expression string to be returned
+    std::to_chars_result MHO_Unit::ToChars(char* first, char* last) const {
+        char* p = first;
         for (int mu=0; mu<NMEAS; mu++) {
-            if (fExp[mu]) {
-                // Get a measurement unit from table 
-                std::string meastr(meas_tab[mu]); 
-                mexpr.append(meastr);
-                if (fExp[mu] != 1) { // Only show non-unity exponents
-                    mexpr.append("^");
-                    mexpr.append(std::to_string(fExp[mu]));
-                }
-                mexpr.append(" * ");
+            if (!fExp[mu]) continue;
+            std::string_view sym = MHO_UnitParser::kMeasTab[mu];
+            std::size_t sep = (p != first) ? 3 : 0;
+            if ((std::size_t) (last - p) < sep + sym.size())
+                return {last, std::errc::value_too_large};
+            for (std::size_t i=0; i<sep; i++) *p++ = " * "[i];
+            for (char c : sym) *p++ = c;
+            if (fExp[mu] != 1) { // Only show non-unity exponents
+                // The '^' here, the digits by std::to_chars
+                if (p == last) return {last, std::errc::value_too_large};
+                *p++ = '^';
+                std::to_chars_result res = std::to_chars(p, last, fExp[mu]);
+                if (res.ec != std::errc()) return res;
+                p = res.ptr;
             }
-            // Cut off the surplus " * " tail
-            int meas_len = mexpr.length();
-            if (meas_len > 3)
-                meas_expr = mexpr.substr(0, meas_len-3);
         }
-        return meas_expr;
-    } // ConstructString()
-} // namespace hops
-
-
-    
-//
-// =================  M A I N  ======================
-//
-
-using namespace hops;
-
-int main(void) {
-
-    char const accel_expr[] = "m/s^2";
-    char const force_expr[] = "kg*m/s^2";
-    char const energy_expr[] = "kg*m^2/s^2";
-    
-    char const meas_expr1[] = "m * ((kg^2*s^-3/A)^-5 * K^5/cd/" \
-        "(mol*Hz)^3*s)^2 * rad * Jy^(7 + 2*(4 - 6))";
-    
-    char const meas_expr2[] = " A*kg*(m^-1*s^-2)^3";
-
-    char const meas_expr3[] = " A * kg *(m^-1*s^-2)^3  ";
-
-    printf("MHO_Unit Declarations:\n");
-    printf("\nMHO_Unit acc: '%s'\n", accel_expr);
-    MHO_Unit acc(accel_expr);
-    
-    printf("\nMHO_Unit F: '%s'\n", force_expr);
-    MHO_Unit F(force_expr);
-    
-    printf("\nMHO_Unit E: '%s'\n", energy_expr);
-    MHO_Unit E;                E.SetUnitString(energy_expr);
-    
-    printf("\nMHO_Unit mass: '%s'\n", "kg");
-    MHO_Unit mass;          mass.SetUnitString("kg");
-
-    MHO_Unit u0;
-    
-    printf("\nMHO_Unit u1: '%s'\n", meas_expr1);
-    MHO_Unit u1(meas_expr1);
-    
-    printf("\nMHO_Unit u2: '%s'\n", meas_expr2);
-    MHO_Unit u2(meas_expr2);
-
-    printf("\nMHO_Unit u3: '%s'\n", meas_expr3);
-    MHO_Unit u3(meas_expr3);
-    
-    printf("\nMHO_Unit u4: '%s'\n", meas_expr2);
-    MHO_Unit u4(meas_expr2);
-    
-
-    std::cout << "Source measure expression 1:\n";
-    std::cout << meas_expr1 << std::endl << std::endl;
-
-    std::cout << "MHO_Unit u1(meas_expr1); u1.GetUnitString():\n";
-    std::cout << u1.GetUnitString() << std::endl << std::endl;
-    std::cout << "u1 exponents: ";
-    std::array<int, NMEAS> aex = u1.GetUnitExp();
-    for (int mu=0; mu<NMEAS; mu++)
-        std::cout << aex[mu] << " ";
-    std::cout << std::endl << std::endl;
-    
-    std::cout << "u0.GetUnitString() -- empty expression.\n";
-    std::cout << u0.GetUnitString() << std::endl;
-    
-    std::cout << "Source measure expression 2:\n";
-    std::cout << meas_expr2 << std::endl << std::endl << std::endl;
-    
-    std::cout << "MHO_Unit u1(meas_expr2); u2.GetUnitString():\n";
-    std::cout << u2.GetUnitString() << std::endl << std::endl;
-
-    std::cout << "u1/u2 = " << std::endl;
-    std::cout << (u1/u2).GetUnitString() << std::endl << std::endl;
-    
-    std::cout << "u2/u1) = " << std::endl;
-    std::cout << (u2/u1).GetUnitString() << std::endl << std::endl;
-    
-    std::cout << "u1*u2 = " << std::endl;
-    std::cout << (u1*u2).GetUnitString() << std::endl << std::endl;
-
-    
-    std::cout << "u2 == u3 = ";
-    std::cout << (u2 == u3 ? "True":"False") << std::endl << std::endl;
-    
-    std::cout << "u2 != u3 = ";
-    std::cout << (u2 != u3 ? "True":"False") << std::endl << std::endl;
-    
-    std::cout << "u1^(-1) = " << std::endl;
-    std::cout << (u1^(-1)).GetUnitString() << std::endl << std::endl;
-
-    u1.Invert();
-    std::cout << "u1.Invert(): " << std::endl;
-    std::cout << u1.GetUnitString() << std::endl << std::endl;
-
-    u1.RaiseToPower(-1);
-    std::cout << "u1.RaiseToPower(-1): " << std::endl;
-    std::cout << u1.GetUnitString() << std::endl
-              << std::endl;
-    
-    std::cout << "F = m*a: (mass * acc).GetUnitString():" << std::endl;
-    std::cout << (mass * acc).GetUnitString() << std::endl << std::endl;
-
-    std::cout << "E/F = s: (E / F).GetUnitString():" << std::endl;
-    std::cout << (E / F).GetUnitString() << std::endl << std::endl;
-
-    u0 = mass*acc; // u0 is F = m * a.
-    std::cout << "F = m*a; : (mass * acc).GetUnitString():" << std::endl;
-    std::cout << u0.GetUnitString() << std::endl << std::endl;
-
-    F ^= -3;
-    std::cout << "F ^= -3;  : F.GetUnitString():" << std::endl;
-    std::cout << F.GetUnitString() << std::endl << std::endl;
-
-    u0 = u4 * "kg^-1 * (m^-1 * s^-2)^(-3) / m^2";
-    std::cout << "u4 = ";
-    std::cout << u4.GetUnitString() << std::endl;
-    std::cout << "u0 = u4 * \"kg^-1 * (m^-1 * s^-2)^(-3) / m^2\";" << std::endl;
-    std::cout << "u0 = ";
-    std::cout << u0.GetUnitString() << std::endl << std::endl;
-
-    u0 = "kg" * acc; // u0 is F = m * a.
-    std::cout << "acc = ";
-    std::cout << acc.GetUnitString() << std::endl;
-    std::cout << "u0 = \"kg\" * acc = ";
-    std::cout << u0.GetUnitString() << std::endl;
-    std::cout << "u0 exponents: ";
-    aex = u0.GetUnitExp();
-    for (int mu=0; mu<NMEAS; mu++)
-        std::cout << aex[mu] << " ";
-    std::cout << std::endl << std::endl;
-
-   
-    u0 = mass * "m/s^2"; // u0 is F = m * a.acc
-    std::cout << "mass = ";
-    std::cout << mass.GetUnitString() << std::endl;
-    std::cout << "u0 = mass * \"m/s^2\" = ";
-    std::cout << u0.GetUnitString() << std::endl << std::endl;
-
-    u0 = u4 / "kg * (m^-1 * s^-2)^3 * m^2";
-    std::cout << "u4 = ";
-    std::cout << u4.GetUnitString() << std::endl;
-    std::cout << "u0 = u4 / \"kg * (m^-1 * s^-2)^3 * m^2\";" << std::endl;
-    std::cout << "u0 = ";
-    std::cout << u0.GetUnitString() << std::endl << std::endl;
+        return {p, std::errc()};
+    }
 
-    u0 = "kg * (m^-1 * s^-2)^3" / acc;
-    std::cout << "acc = ";
-    std::cout << acc.GetUnitString() << std::endl;
-    std::cout << "u0 = ""kg * (m^-1 * s^-2)^3"" / acc;" << std::endl;
-    std::cout << "u0 = ";
-    std::cout << u0.GetUnitString() << std::endl << std::endl;
+    //
+    // Construct a human-readable string from the base unit exponents,
+    // by ToChars() on the stack
+    //
+    std::string MHO_Unit::GetUnitString() const {
+        char buf[kMaxChars];
+        std::to_chars_result res = ToChars(buf, buf + kMaxChars);
+        return std::string(buf, res.ptr);
+    } // GetUnitString()
+} // namespace hops
 
-    
-    return 0;            
-}
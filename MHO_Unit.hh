@@ -1,31 +1,149 @@
+#ifndef MHO_Unit_HH__
+#define MHO_Unit_HH__
+
 #include <string>
 #include <array>
+#include <charconv>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string_view>
+#include <type_traits>
 #include "read_units.h"
+#include "MHO_Expected.hh"
+#include "MHO_UnitParser.hh"
 
 
 namespace hops 
 {
 
+    template <typename E> class MHO_UnitExpr;
+
+    //
+    // A unit as the array of exponents of the NMEAS base units, and
+    // nothing else: a trivially copyable value type of 48 bytes, which
+    // large arrays can copy, sort and write out as plain memory. The
+    // algebra is inline, constexpr and noexcept; the parsing and the
+    // string operators are not.
+    //
     class MHO_Unit 
     {
     public:
-        MHO_Unit();
+        // The parsers of unit strings: Flex/Bison, or the hand-written
+        // MHO_UnitParser, which accepts the same language and performs
+        // no heap allocation below 8 nested parentheses
+        enum Engine { kFlexBison = 0, kHandWritten };
+
+        // Engine for the strings parsed from now on, in all threads
+        static void SetEngine(Engine engine);
+        static Engine GetEngine();
+
+        // Parse a batch of unit strings on nthreads threads (0: one per
+        // core) with the hand-written parser. exps[i] gets the exponents
+        // of units[i], all zero if it is invalid, and errors[i], if errors
+        // is given, its error code. Nothing is thrown or printed. Only the
+        // first min(units.size(), exps.size()) strings are parsed, and
+        // errors must be empty or as long as exps.
+        // Returns the number of invalid strings.
+        static std::size_t ParseMany(
+            std::span<const std::string_view> units,
+            std::span<std::array<int, NMEAS> > exps,
+            std::span<MHO_UnitParser::Error> errors = {},
+            unsigned nthreads = 0);
+
+        // The error of TryParse(): what, and where in the text (a byte
+        // offset)
+        struct ParseError {
+            MHO_UnitParser::Error fCode;
+            std::size_t fOffset;
+            const char* What() const {
+                return MHO_UnitParser::ErrorString(fCode);
+            }
+        };
+
+        // Parse the unit with no I/O, no exception and, on failure, no
+        // allocation, unless the parentheses nest more than 8 deep (see
+        // MHO_UnitParser): stops at the first error, and returns it.
+        // Unlike the constructors, which skip illegal characters (printing
+        // them, with Flex), it rejects them, since they mean the text is
+        // damaged.
+        // It always runs the hand-written parser, and bypasses the
+        // MHO_UnitCache.
+        static MHO_Expected<MHO_Unit, ParseError> TryParse(
+            std::string_view unit);
+
+        constexpr MHO_Unit() noexcept: fExp{} {};
         MHO_Unit(const std::string& unit);
-        virtual ~MHO_Unit() { };
+
+        // The same, from a view or a char range, such as a field sliced
+        // out of a memory-mapped file: the text needs no terminating null
+        // and is never written to. The kHandWritten engine scans it in
+        // place; Flex/Bison copies it into a buffer of the thread, reused
+        // from parse to parse.
+        explicit MHO_Unit(const char* unit):
+            MHO_Unit(std::string_view(unit)) {};
+        explicit MHO_Unit(std::string_view unit);
+        MHO_Unit(const char* unit, std::size_t len):
+            MHO_Unit(std::string_view(unit, len)) {};
+        constexpr explicit MHO_Unit(const std::array<int, NMEAS>& exp)
+            noexcept: fExp(exp) {};
+
+        // Evaluate an expression of units (see MHO_UnitExpr) straight
+        // into this one, in one pass
+        template <typename E>
+        constexpr MHO_Unit(const MHO_UnitExpr<E>& expr) noexcept;
         
         //setter and getter for string representation
-        void SetUnitString(const std::string unit) { Parse(unit); };
-        std::string GetUnitString() const { return ConstructString(); }
+        //
+        // The string is built on every call, by ToChars(), with at most
+        // one allocation (none for the short strings); where that is too
+        // much, as in big tables, use ToChars() itself.
+        void SetUnitString(std::string_view unit) { Parse(unit); };
+        std::string GetUnitString() const;
+
+        // The longest string of a unit: every symbol with "^" and an
+        // exponent of 11 characters, and the " * " between them
+        static constexpr std::size_t kMaxChars = [] {
+            std::size_t len = 3*(NMEAS - 1);
+            for (std::string_view sym : MHO_UnitParser::kMeasTab)
+                len += sym.size() + 1 + 11;
+            return len;
+        }();
+
+        // Write the string of GetUnitString() to [first, last), without
+        // a terminating null, like std::to_chars: returns the end of the
+        // string, or last and std::errc::value_too_large if it does not
+        // fit (then the contents of the buffer are unspecified). Makes no
+        // allocation; kMaxChars is always enough.
+        std::to_chars_result ToChars(char* first, char* last) const;
 
         //setter and getter for the unit exponrnts
-        void SetUnitExp(const std::array<int, NMEAS> fExp);
-        std::array<int, NMEAS> GetUnitExp() const { return fExp; }
+        constexpr void SetUnitExp(const std::array<int, NMEAS>& exp) noexcept {
+            fExp = exp;
+        }
+        constexpr std::array<int, NMEAS> GetUnitExp() const noexcept {
+            return fExp;
+        }
 
 
-        // operator overloads for multiplication and division
-        MHO_Unit operator*(const MHO_Unit& other) const;
-        MHO_Unit operator/(const MHO_Unit& other) const;
-        
+        // Multiplication, division and unit^power of units: the left
+        // operand is taken by value, so in a chain such as a*b*c the
+        // temporary of a*b is reused; see also MHO_UnitExpr, below
+        friend constexpr MHO_Unit operator*(MHO_Unit lhs,
+                                            const MHO_Unit& rhs) noexcept {
+            return lhs *= rhs;
+        }
+        friend constexpr MHO_Unit operator/(MHO_Unit lhs,
+                                            const MHO_Unit& rhs) noexcept {
+            return lhs /= rhs;
+        }
+        friend constexpr MHO_Unit operator^(MHO_Unit base,
+                                            int power) noexcept {
+            return base ^= power;
+        }
+
         //
         // Operator overloads for multiplication by a string literal
         //
@@ -47,40 +165,346 @@ namespace hops
         friend MHO_Unit operator/(const std::string& lhs, const MHO_Unit& rhs);
         
         // operator overloads for compound assignment
-        MHO_Unit& operator*=(const MHO_Unit& other);
-        MHO_Unit& operator/=(const MHO_Unit& other);
+        constexpr MHO_Unit& operator*=(const MHO_Unit& other) noexcept {
+            for (int mu=0; mu<NMEAS; mu++) fExp[mu] += other.fExp[mu];
+            return *this;
+        }
+        constexpr MHO_Unit& operator/=(const MHO_Unit& other) noexcept {
+            for (int mu=0; mu<NMEAS; mu++) fExp[mu] -= other.fExp[mu];
+            return *this;
+        }
+        template <typename E>
+        constexpr MHO_Unit& operator*=(const MHO_UnitExpr<E>& expr) noexcept;
+        template <typename E>
+        constexpr MHO_Unit& operator/=(const MHO_UnitExpr<E>& expr) noexcept;
         
         //raise the unit to an integer power 
-        void RaiseToPower(int power);
+        constexpr void RaiseToPower(int power) noexcept {
+            for (int mu=0; mu<NMEAS; mu++) fExp[mu] *= power;
+        }
         
-        // Yet another raise the unit to an integer power: unit^power
-        MHO_Unit operator^(int power);
-        MHO_Unit operator^=(int power);
+        // Yet another raise the unit to an integer power: unit^=power
+        constexpr MHO_Unit& operator^=(int power) noexcept {
+            RaiseToPower(power);
+            return *this;
+        }
 
         //invert the unit:
-        void Invert();
+        constexpr void Invert() noexcept { RaiseToPower(-1); }
 
-        // equality operators
-        bool operator==(const MHO_Unit& other) const;
-        bool operator!=(const MHO_Unit& other) const;
+        // equality operators (!= is derived from ==)
+        constexpr bool operator==(const MHO_Unit& other) const noexcept {
+            return fExp == other.fExp;
+        }
+
+        // Total order: lexicographic in the exponents, in the order of
+        // meas_tab, so units can key ordered containers and sorted arrays
+        constexpr std::strong_ordering operator<=>(const MHO_Unit& other)
+            const noexcept {
+            return fExp <=> other.fExp;
+        }
+
+        //
+        // Hash of the exponents, also as std::hash<MHO_Unit>: two at a
+        // time, as 64-bit words, through a multiply-xorshift mixer, so
+        // that every exponent bit reaches every hash bit
+        //
+        constexpr std::size_t Hash() const noexcept {
+            uint64_t h = 0x9e3779b97f4a7c15ULL;
+            for (int mu=0; mu<NMEAS; mu+=2) {
+                uint64_t w = (uint32_t) fExp[mu];
+                if (mu + 1 < NMEAS)
+                    w |= (uint64_t) (uint32_t) fExp[mu+1] << 32;
+                h = (h ^ w) * 0xbf58476d1ce4e5b9ULL;
+                h ^= h >> 31;
+            }
+            return (std::size_t) h;
+        }
         
-        //assignment operator
-        MHO_Unit& operator=(const MHO_Unit& other);
+        // assignment from an expression; the copy and move operations
+        // are the implicit, trivial ones
+        template <typename E>
+        constexpr MHO_Unit& operator=(const MHO_UnitExpr<E>& expr) noexcept;
 
     private:
+
+        friend class MHO_UnitRef;
+        friend class MHO_UnitVal;
         
-        std::string fStringRep;
         std::array<int, NMEAS> fExp;
 
-        // Constructs a human readable string from the base unit exponents
-        virtual std::string ConstructString() const;
-
         // Parse() takes a string and determines the appropriate
         // unit exponents, and sets them in fExp
     
-        virtual void Parse(const std::string& repl); 
+        void Parse(std::string_view repl);
+
+    };
+
+    static_assert(std::is_trivially_copyable_v<MHO_Unit> &&
+                  std::is_standard_layout_v<MHO_Unit> &&
+                  sizeof(MHO_Unit) == NMEAS*sizeof(int),
+                  "MHO_Unit must stay a plain array of exponents");
+
+
+    //
+    // Expression templates of the unit algebra. A product of two units is
+    // an MHO_Unit; a product, quotient or power of an expression is not
+    // computed where it is written: it is a small object naming its
+    // operands. A chain started with MHO_UnitRef, such as
+    //
+    //     MHO_Unit u = MHO_UnitRef(u1)*u2/(u3^2)*u4;
+    //
+    // is evaluated exponent by exponent straight into u, with no MHO_Unit
+    // temporaries past u3^2. An expression converts to MHO_Unit wherever
+    // one is expected, has GetUnitExp() and GetUnitString() of its own,
+    // and is multiplied and divided by strings as an MHO_Unit is.
+    //
+    // The operands that are named units are held by reference, and the
+    // temporary ones by value, so an expression must not outlive the
+    // units it names: evaluate it into an MHO_Unit rather than keep it
+    // with auto. As ^ binds more loosely than * and /, write u1*(u2^2).
+    //
+    class MHO_UnitExprBase {};
+
+    template <typename E>
+    class MHO_UnitExpr: public MHO_UnitExprBase
+    {
+    public:
+
+        // The exponent of the base unit mu
+        constexpr int Exp(int mu) const noexcept {
+            return static_cast<const E&>(*this).Exp(mu);
+        }
+
+        constexpr std::array<int, NMEAS> GetUnitExp() const noexcept {
+            std::array<int, NMEAS> exp;
+            for (int mu=0; mu<NMEAS; mu++) exp[mu] = Exp(mu);
+            return exp;
+        }
+
+        std::string GetUnitString() const {
+            return MHO_Unit(*this).GetUnitString();
+        }
+    };
+
+    // A named unit
+    class MHO_UnitRef: public MHO_UnitExpr<MHO_UnitRef>
+    {
+    public:
+        constexpr MHO_UnitRef(const MHO_Unit& unit) noexcept: fUnit(unit) {};
+        constexpr int Exp(int mu) const noexcept { return fUnit.fExp[mu]; }
+    private:
+        const MHO_Unit& fUnit;
+    };
+
+    // A temporary unit, copied
+    class MHO_UnitVal: public MHO_UnitExpr<MHO_UnitVal>
+    {
+    public:
+        constexpr MHO_UnitVal(const MHO_Unit& unit) noexcept: fUnit(unit) {};
+        constexpr int Exp(int mu) const noexcept { return fUnit.fExp[mu]; }
+    private:
+        MHO_Unit fUnit;
+    };
+
+    // L*R for kSign = 1, L/R for kSign = -1
+    template <typename L, typename R, int kSign>
+    class MHO_UnitProduct: public MHO_UnitExpr<MHO_UnitProduct<L, R, kSign> >
+    {
+    public:
+        constexpr MHO_UnitProduct(const L& lhs, const R& rhs) noexcept:
+            fLhs(lhs), fRhs(rhs) {};
+        constexpr int Exp(int mu) const noexcept {
+            return fLhs.Exp(mu) + kSign*fRhs.Exp(mu);
+        }
+    private:
+        L fLhs;
+        R fRhs;
+    };
 
+    template <typename B>
+    class MHO_UnitPower: public MHO_UnitExpr<MHO_UnitPower<B> >
+    {
+    public:
+        constexpr MHO_UnitPower(const B& base, int power) noexcept:
+            fBase(base), fPower(power) {};
+        constexpr int Exp(int mu) const noexcept {
+            return fPower*fBase.Exp(mu);
+        }
+    private:
+        B fBase;
+        int fPower;
     };
 
+    // An expression of units
+    template <typename T>
+    concept MHO_UnitExprOperand =
+        std::is_base_of_v<MHO_UnitExprBase, std::remove_cvref_t<T> >;
+
+    // An MHO_Unit or an expression of units
+    template <typename T>
+    concept MHO_UnitOperand =
+        std::is_same_v<std::remove_cvref_t<T>, MHO_Unit> ||
+        MHO_UnitExprOperand<T>;
+
+    // How an operand is held in an expression
+    template <typename T>
+    using MHO_UnitNode = std::conditional_t<
+        std::is_same_v<std::remove_cvref_t<T>, MHO_Unit>,
+        std::conditional_t<std::is_lvalue_reference_v<T>,
+                           MHO_UnitRef, MHO_UnitVal>,
+        std::remove_cvref_t<T> >;
+
+    // At least one operand is an expression (two MHO_Units make an
+    // MHO_Unit)
+    template <MHO_UnitOperand L, MHO_UnitOperand R>
+        requires MHO_UnitExprOperand<L> || MHO_UnitExprOperand<R>
+    constexpr MHO_UnitProduct<MHO_UnitNode<L>, MHO_UnitNode<R>, 1>
+    operator*(L&& lhs, R&& rhs) noexcept {
+        return {MHO_UnitNode<L>(lhs), MHO_UnitNode<R>(rhs)};
+    }
+
+    template <MHO_UnitOperand L, MHO_UnitOperand R>
+        requires MHO_UnitExprOperand<L> || MHO_UnitExprOperand<R>
+    constexpr MHO_UnitProduct<MHO_UnitNode<L>, MHO_UnitNode<R>, -1>
+    operator/(L&& lhs, R&& rhs) noexcept {
+        return {MHO_UnitNode<L>(lhs), MHO_UnitNode<R>(rhs)};
+    }
+
+    template <MHO_UnitExprOperand B>
+    constexpr MHO_UnitPower<MHO_UnitNode<B> > operator^(B&& base,
+                                                         int power) noexcept {
+        return {MHO_UnitNode<B>(base), power};
+    }
+
+    // An expression by a string: evaluated, then as for an MHO_Unit
+    template <typename E>
+    MHO_Unit operator*(const MHO_UnitExpr<E>& lhs, const std::string& rhs) {
+        return MHO_Unit(lhs) * rhs;
+    }
+    template <typename E>
+    MHO_Unit operator/(const MHO_UnitExpr<E>& lhs, const std::string& rhs) {
+        return MHO_Unit(lhs) / rhs;
+    }
+    template <typename E>
+    MHO_Unit operator*(const std::string& lhs, const MHO_UnitExpr<E>& rhs) {
+        return lhs * MHO_Unit(rhs);
+    }
+    template <typename E>
+    MHO_Unit operator/(const std::string& lhs, const MHO_UnitExpr<E>& rhs) {
+        return lhs / MHO_Unit(rhs);
+    }
+
+    // Compared without evaluating either side (an expression against an
+    // MHO_Unit uses MHO_Unit::operator==)
+    template <typename E1, typename E2>
+    constexpr bool operator==(const MHO_UnitExpr<E1>& lhs,
+                              const MHO_UnitExpr<E2>& rhs) noexcept {
+        for (int mu=0; mu<NMEAS; mu++)
+            if (lhs.Exp(mu) != rhs.Exp(mu)) return false;
+        return true;
+    }
+
+    // Each exponent is read before it is written, so the destination may
+    // also be an operand
+    template <typename E>
+    constexpr MHO_Unit::MHO_Unit(const MHO_UnitExpr<E>& expr) noexcept {
+        for (int mu=0; mu<NMEAS; mu++) fExp[mu] = expr.Exp(mu);
+    }
+
+    template <typename E>
+    constexpr MHO_Unit& MHO_Unit::operator=(const MHO_UnitExpr<E>& expr)
+        noexcept {
+        for (int mu=0; mu<NMEAS; mu++) fExp[mu] = expr.Exp(mu);
+        return *this;
+    }
+
+    template <typename E>
+    constexpr MHO_Unit& MHO_Unit::operator*=(const MHO_UnitExpr<E>& expr)
+        noexcept {
+        for (int mu=0; mu<NMEAS; mu++) fExp[mu] += expr.Exp(mu);
+        return *this;
+    }
+
+    template <typename E>
+    constexpr MHO_Unit& MHO_Unit::operator/=(const MHO_UnitExpr<E>& expr)
+        noexcept {
+        for (int mu=0; mu<NMEAS; mu++) fExp[mu] -= expr.Exp(mu);
+        return *this;
+    }
+
+
+    //
+    // Unit literals, parsed at compile time:
+    //
+    //     using namespace hops::unit_literals;
+    //     MHO_Unit a = "m/s^2"_unit;
+    //
+    // A misspelled unit or a syntax error is a compile error, reported as
+    // a call to one of the non-constexpr functions below.
+    //
+    namespace unit_literals
+    {
+        template <std::size_t N>
+        struct MHO_UnitString
+        {
+            char fStr[N] {};
+            constexpr MHO_UnitString(const char (&str)[N]) {
+                for (std::size_t i=0; i<N; i++) fStr[i] = str[i];
+            }
+            constexpr std::string_view View() const {
+                return std::string_view(fStr, N-1);
+            }
+        };
+
+        inline void unit_literal_error_empty_string() {}
+        inline void unit_literal_error_no_measurement_units() {}
+        inline void unit_literal_error_no_such_measurement_unit() {}
+        inline void unit_literal_error_illegal_character() {}
+        inline void unit_literal_error_division_by_zero() {}
+        inline void unit_literal_error_exponent_too_deep() {}
+        inline void unit_literal_error_exponent_overflow() {}
+        inline void unit_literal_error_syntax() {}
+
+        template <MHO_UnitString S>
+        consteval std::array<int, NMEAS> UnitLiteralExp() {
+            MHO_UnitParser::Result res = MHO_UnitParser(S.View()).Parse();
+            switch (res.fError) {
+            case MHO_UnitParser::kNone: break;
+            case MHO_UnitParser::kEmpty:
+                unit_literal_error_empty_string(); break;
+            case MHO_UnitParser::kNumberOnly:
+                unit_literal_error_no_measurement_units(); break;
+            case MHO_UnitParser::kUnknownSymbol:
+                unit_literal_error_no_such_measurement_unit(); break;
+            case MHO_UnitParser::kIllegalChar:
+                unit_literal_error_illegal_character(); break;
+            case MHO_UnitParser::kDivByZero:
+                unit_literal_error_division_by_zero(); break;
+            case MHO_UnitParser::kTooDeep:
+                unit_literal_error_exponent_too_deep(); break;
+            case MHO_UnitParser::kOverflow:
+                unit_literal_error_exponent_overflow(); break;
+            default:
+                unit_literal_error_syntax();
+            }
+            return res.fExp;
+        }
+
+        template <MHO_UnitString S>
+        MHO_Unit operator""_unit() {
+            return MHO_Unit(UnitLiteralExp<S>());
+        }
+    }
 
 }
+
+template <>
+struct std::hash<hops::MHO_Unit>
+{
+    std::size_t operator()(const hops::MHO_Unit& unit) const noexcept {
+        return unit.Hash();
+    }
+};
+
+#endif /* end of include guard: MHO_Unit_HH__ */
@@ -0,0 +1,602 @@
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include "MHO_UnitArray.hh"
+#include "MHO_UnitDimension.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MHO_UNIT_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace hops
+{
+
+    namespace
+    {
+        //
+        // The kernels, on one column each: c = a + b, c = a - b, c = a*k
+        // (each returning true on an int8_t overflow), m &= (a == b),
+        // m &= (a == x), and for the projection onto the
+        // base dimensions, acc += k*a and m &= (acc == 0) on int16_t
+        // sums. The masks hold 0 or 1. Each x86 variant is compiled for
+        // its own instruction set and chosen at run time from the CPU
+        // features.
+        //
+        enum Kernel { kScalar, kAvx2, kAvx512 };
+
+        bool Fits(long long v) {
+            return v >= std::numeric_limits<int8_t>::min() &&
+                   v <= std::numeric_limits<int8_t>::max();
+        }
+
+        bool AddScalar(const int8_t* a, const int8_t* b, int8_t* c,
+                       std::size_t n) {
+            bool ovf = false;
+            for (std::size_t i=0; i<n; i++) {
+                int s = a[i] + b[i];
+                ovf |= !Fits(s);
+                c[i] = (int8_t) s;
+            }
+            return ovf;
+        }
+
+        bool SubScalar(const int8_t* a, const int8_t* b, int8_t* c,
+                       std::size_t n) {
+            bool ovf = false;
+            for (std::size_t i=0; i<n; i++) {
+                int d = a[i] - b[i];
+                ovf |= !Fits(d);
+                c[i] = (int8_t) d;
+            }
+            return ovf;
+        }
+
+        bool MulScalar(const int8_t* a, int k, int8_t* c, std::size_t n) {
+            bool ovf = false;
+            for (std::size_t i=0; i<n; i++) {
+                long long p = (long long) a[i]*k;
+                ovf |= !Fits(p);
+                c[i] = (int8_t) p;
+            }
+            return ovf;
+        }
+
+        void EqScalar(const int8_t* a, const int8_t* b, uint8_t* m,
+                      std::size_t n) {
+            for (std::size_t i=0; i<n; i++) m[i] &= (a[i] == b[i]);
+        }
+
+        void EqScalar(const int8_t* a, int8_t x, uint8_t* m, std::size_t n) {
+            for (std::size_t i=0; i<n; i++) m[i] &= (a[i] == x);
+        }
+
+        void MacScalar(const int8_t* a, int k, int16_t* acc, std::size_t n) {
+            for (std::size_t i=0; i<n; i++) acc[i] += (int16_t) (k*a[i]);
+        }
+
+        void ZeroScalar(const int16_t* acc, uint8_t* m, std::size_t n) {
+            for (std::size_t i=0; i<n; i++) m[i] &= (acc[i] == 0);
+        }
+
+#ifdef MHO_UNIT_X86
+        //
+        // A lane overflows in a + b if a and b have the same sign and the
+        // sum has the other one, and in a - b if a and b have different
+        // signs and the difference has the sign of b: the sign bits of
+        // (a^s) & (b^s), and of (a^b) & (a^d), are or-ed up.
+        //
+        __attribute__((target("avx2")))
+        bool AddAvx2(const int8_t* a, const int8_t* b, int8_t* c,
+                     std::size_t n) {
+            __m256i ovf = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+                __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+                __m256i s = _mm256_add_epi8(va, vb);
+                ovf = _mm256_or_si256(ovf, _mm256_and_si256(
+                    _mm256_xor_si256(va, s), _mm256_xor_si256(vb, s)));
+                _mm256_storeu_si256((__m256i*) (c + i), s);
+            }
+            return (_mm256_movemask_epi8(ovf) != 0) |
+                   AddScalar(a + i, b + i, c + i, n - i);
+        }
+
+        __attribute__((target("avx2")))
+        bool SubAvx2(const int8_t* a, const int8_t* b, int8_t* c,
+                     std::size_t n) {
+            __m256i ovf = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+                __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+                __m256i d = _mm256_sub_epi8(va, vb);
+                ovf = _mm256_or_si256(ovf, _mm256_and_si256(
+                    _mm256_xor_si256(va, vb), _mm256_xor_si256(va, d)));
+                _mm256_storeu_si256((__m256i*) (c + i), d);
+            }
+            return (_mm256_movemask_epi8(ovf) != 0) |
+                   SubScalar(a + i, b + i, c + i, n - i);
+        }
+
+        //
+        // No int8 multiply: widen to int16, where |a*k| <= 128*128 fits,
+        // and narrow back to the low bytes, which packus keeps unchanged
+        // once the high ones are cleared, so an overflow wraps around as
+        // in the scalar loop. A product overflows if it is not the sign
+        // extension of its low byte.
+        //
+        __attribute__((target("avx2")))
+        bool MulAvx2(const int8_t* a, int k, int8_t* c, std::size_t n) {
+            if (!Fits(k)) return MulScalar(a, k, c, n);
+            __m256i vk = _mm256_set1_epi16((short) k);
+            __m256i low = _mm256_set1_epi16(0xFF);
+            __m256i ovf = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m256i lo = _mm256_mullo_epi16(vk, _mm256_cvtepi8_epi16(
+                    _mm_loadu_si128((const __m128i*) (a + i))));
+                __m256i hi = _mm256_mullo_epi16(vk, _mm256_cvtepi8_epi16(
+                    _mm_loadu_si128((const __m128i*) (a + i + 16))));
+                ovf = _mm256_or_si256(ovf, _mm256_xor_si256(lo,
+                    _mm256_srai_epi16(_mm256_slli_epi16(lo, 8), 8)));
+                ovf = _mm256_or_si256(ovf, _mm256_xor_si256(hi,
+                    _mm256_srai_epi16(_mm256_slli_epi16(hi, 8), 8)));
+                // packus works within 128-bit lanes: put them in order
+                __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi16(
+                    _mm256_and_si256(lo, low), _mm256_and_si256(hi, low)),
+                    0xD8);
+                _mm256_storeu_si256((__m256i*) (c + i), p);
+            }
+            return !_mm256_testz_si256(ovf, ovf) |
+                   MulScalar(a + i, k, c + i, n - i);
+        }
+
+        __attribute__((target("avx2")))
+        void EqAvx2(const int8_t* a, const int8_t* b, uint8_t* m,
+                    std::size_t n) {
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+                __m256i vb = _mm256_loadu_si256((const __m256i*) (b + i));
+                __m256i vm = _mm256_loadu_si256((const __m256i*) (m + i));
+                _mm256_storeu_si256((__m256i*) (m + i), _mm256_and_si256(
+                    vm, _mm256_cmpeq_epi8(va, vb)));
+            }
+            EqScalar(a + i, b + i, m + i, n - i);
+        }
+
+        __attribute__((target("avx2")))
+        void EqAvx2(const int8_t* a, int8_t x, uint8_t* m, std::size_t n) {
+            __m256i vx = _mm256_set1_epi8(x);
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m256i va = _mm256_loadu_si256((const __m256i*) (a + i));
+                __m256i vm = _mm256_loadu_si256((const __m256i*) (m + i));
+                _mm256_storeu_si256((__m256i*) (m + i), _mm256_and_si256(
+                    vm, _mm256_cmpeq_epi8(va, vx)));
+            }
+            EqScalar(a + i, x, m + i, n - i);
+        }
+
+        __attribute__((target("avx2")))
+        void MacAvx2(const int8_t* a, int k, int16_t* acc, std::size_t n) {
+            __m256i vk = _mm256_set1_epi16((short) k);
+            std::size_t i = 0;
+            for (; i+16<=n; i+=16) {
+                __m256i p = _mm256_mullo_epi16(vk, _mm256_cvtepi8_epi16(
+                    _mm_loadu_si128((const __m128i*) (a + i))));
+                __m256i* va = (__m256i*) (acc + i);
+                _mm256_storeu_si256(va, _mm256_add_epi16(
+                    _mm256_loadu_si256(va), p));
+            }
+            MacScalar(a + i, k, acc + i, n - i);
+        }
+
+        // The int16 compares are packed into bytes of 0 or -1, in order
+        __attribute__((target("avx2")))
+        void ZeroAvx2(const int16_t* acc, uint8_t* m, std::size_t n) {
+            __m256i zero = _mm256_setzero_si256();
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m256i lo = _mm256_cmpeq_epi16(zero, _mm256_loadu_si256(
+                    (const __m256i*) (acc + i)));
+                __m256i hi = _mm256_cmpeq_epi16(zero, _mm256_loadu_si256(
+                    (const __m256i*) (acc + i + 16)));
+                __m256i eq = _mm256_permute4x64_epi64(
+                    _mm256_packs_epi16(lo, hi), 0xD8);
+                __m256i vm = _mm256_loadu_si256((const __m256i*) (m + i));
+                _mm256_storeu_si256((__m256i*) (m + i),
+                                    _mm256_and_si256(vm, eq));
+            }
+            ZeroScalar(acc + i, m + i, n - i);
+        }
+
+        // The tails are done with masked loads and stores
+        __mmask64 TailMask(std::size_t n) {
+            return (n >= 64) ? ~0ULL : (1ULL << n) - 1;
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        bool AddAvx512(const int8_t* a, const int8_t* b, int8_t* c,
+                       std::size_t n) {
+            __m512i ovf = _mm512_setzero_si512();
+            for (std::size_t i=0; i<n; i+=64) {
+                __mmask64 m = TailMask(n - i);
+                __m512i va = _mm512_maskz_loadu_epi8(m, a + i);
+                __m512i vb = _mm512_maskz_loadu_epi8(m, b + i);
+                __m512i s = _mm512_add_epi8(va, vb);
+                ovf = _mm512_or_si512(ovf, _mm512_and_si512(
+                    _mm512_xor_si512(va, s), _mm512_xor_si512(vb, s)));
+                _mm512_mask_storeu_epi8(c + i, m, s);
+            }
+            return _mm512_movepi8_mask(ovf) != 0;
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        bool SubAvx512(const int8_t* a, const int8_t* b, int8_t* c,
+                       std::size_t n) {
+            __m512i ovf = _mm512_setzero_si512();
+            for (std::size_t i=0; i<n; i+=64) {
+                __mmask64 m = TailMask(n - i);
+                __m512i va = _mm512_maskz_loadu_epi8(m, a + i);
+                __m512i vb = _mm512_maskz_loadu_epi8(m, b + i);
+                __m512i d = _mm512_sub_epi8(va, vb);
+                ovf = _mm512_or_si512(ovf, _mm512_and_si512(
+                    _mm512_xor_si512(va, vb), _mm512_xor_si512(va, d)));
+                _mm512_mask_storeu_epi8(c + i, m, d);
+            }
+            return _mm512_movepi8_mask(ovf) != 0;
+        }
+
+        // Widened to int16 as in MulAvx2; the narrowing truncates to the
+        // low byte, which wraps around as in the scalar loop, and a
+        // product overflows if it does not survive the round trip
+        __attribute__((target("avx512f,avx512bw")))
+        bool MulAvx512(const int8_t* a, int k, int8_t* c, std::size_t n) {
+            if (!Fits(k)) return MulScalar(a, k, c, n);
+            __m512i vk = _mm512_set1_epi16((short) k);
+            __mmask32 ovf = 0;
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m512i p = _mm512_mullo_epi16(vk, _mm512_cvtepi8_epi16(
+                    _mm256_loadu_si256((const __m256i*) (a + i))));
+                // (maskz: the plain form warns of an uninitialized value)
+                __m256i q = _mm512_maskz_cvtepi16_epi8(~0u, p);
+                ovf |= _mm512_cmpneq_epi16_mask(p, _mm512_cvtepi8_epi16(q));
+                _mm256_storeu_si256((__m256i*) (c + i), q);
+            }
+            return (ovf != 0) | MulScalar(a + i, k, c + i, n - i);
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        void EqAvx512(const int8_t* a, const int8_t* b, uint8_t* m,
+                      std::size_t n) {
+            for (std::size_t i=0; i<n; i+=64) {
+                __mmask64 t = TailMask(n - i);
+                __mmask64 eq = _mm512_cmpeq_epi8_mask(
+                    _mm512_maskz_loadu_epi8(t, a + i),
+                    _mm512_maskz_loadu_epi8(t, b + i));
+                __m512i vm = _mm512_maskz_loadu_epi8(t, m + i);
+                _mm512_mask_storeu_epi8(m + i, t,
+                                        _mm512_maskz_mov_epi8(eq, vm));
+            }
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        void EqAvx512(const int8_t* a, int8_t x, uint8_t* m, std::size_t n) {
+            __m512i vx = _mm512_set1_epi8(x);
+            for (std::size_t i=0; i<n; i+=64) {
+                __mmask64 t = TailMask(n - i);
+                __mmask64 eq = _mm512_cmpeq_epi8_mask(
+                    _mm512_maskz_loadu_epi8(t, a + i), vx);
+                __m512i vm = _mm512_maskz_loadu_epi8(t, m + i);
+                _mm512_mask_storeu_epi8(m + i, t,
+                                        _mm512_maskz_mov_epi8(eq, vm));
+            }
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        void MacAvx512(const int8_t* a, int k, int16_t* acc, std::size_t n) {
+            __m512i vk = _mm512_set1_epi16((short) k);
+            std::size_t i = 0;
+            for (; i+32<=n; i+=32) {
+                __m512i p = _mm512_mullo_epi16(vk, _mm512_cvtepi8_epi16(
+                    _mm256_loadu_si256((const __m256i*) (a + i))));
+                _mm512_storeu_si512(acc + i, _mm512_add_epi16(
+                    _mm512_loadu_si512(acc + i), p));
+            }
+            MacScalar(a + i, k, acc + i, n - i);
+        }
+
+        __attribute__((target("avx512f,avx512bw")))
+        void ZeroAvx512(const int16_t* acc, uint8_t* m, std::size_t n) {
+            __m512i zero = _mm512_setzero_si512();
+            std::size_t i = 0;
+            for (; i+64<=n; i+=64) {
+                __mmask64 eq = (__mmask64) _mm512_cmpeq_epi16_mask(
+                    zero, _mm512_loadu_si512(acc + i)) |
+                    (__mmask64) _mm512_cmpeq_epi16_mask(
+                    zero, _mm512_loadu_si512(acc + i + 32)) << 32;
+                _mm512_storeu_si512(m + i, _mm512_maskz_mov_epi8(
+                    eq, _mm512_loadu_si512(m + i)));
+            }
+            ZeroScalar(acc + i, m + i, n - i);
+        }
+#endif
+
+        Kernel GetKernel() {
+            static const Kernel kernel = [] {
+#ifdef MHO_UNIT_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512bw")) return kAvx512;
+                if (__builtin_cpu_supports("avx2")) return kAvx2;
+#endif
+                return kScalar;
+            }();
+            return kernel;
+        }
+
+        bool Add(const int8_t* a, const int8_t* b, int8_t* c, std::size_t n) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: return AddAvx512(a, b, c, n);
+            case kAvx2: return AddAvx2(a, b, c, n);
+#endif
+            default: return AddScalar(a, b, c, n);
+            }
+        }
+
+        bool Sub(const int8_t* a, const int8_t* b, int8_t* c, std::size_t n) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: return SubAvx512(a, b, c, n);
+            case kAvx2: return SubAvx2(a, b, c, n);
+#endif
+            default: return SubScalar(a, b, c, n);
+            }
+        }
+
+        bool Mul(const int8_t* a, int k, int8_t* c, std::size_t n) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: return MulAvx512(a, k, c, n);
+            case kAvx2: return MulAvx2(a, k, c, n);
+#endif
+            default: return MulScalar(a, k, c, n);
+            }
+        }
+
+        template <typename B>
+        void Eq(const int8_t* a, B b, uint8_t* m, std::size_t n) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: EqAvx512(a, b, m, n); return;
+            case kAvx2: EqAvx2(a, b, m, n); return;
+#endif
+            default: EqScalar(a, b, m, n); return;
+            }
+        }
+
+        void Mac(const int8_t* a, int k, int16_t* acc, std::size_t n) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: MacAvx512(a, k, acc, n); return;
+            case kAvx2: MacAvx2(a, k, acc, n); return;
+#endif
+            default: MacScalar(a, k, acc, n); return;
+            }
+        }
+
+        void Zero(const int16_t* acc, uint8_t* m, std::size_t n) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: ZeroAvx512(acc, m, n); return;
+            case kAvx2: ZeroAvx2(acc, m, n); return;
+#endif
+            default: ZeroScalar(acc, m, n); return;
+            }
+        }
+
+        [[noreturn]] void Overflow() {
+            throw std::overflow_error("MHO_UnitArray: exponent overflow");
+        }
+    }
+
+
+    MHO_UnitArray::MHO_UnitArray(std::size_t size, const MHO_Unit& unit):
+        fSize(size) {
+        std::array<int8_t, NMEAS> exp = Narrow(unit);
+        for (int mu=0; mu<NMEAS; mu++) fCol[mu].assign(size, exp[mu]);
+    }
+
+    MHO_UnitArray::MHO_UnitArray(std::span<const MHO_Unit> units):
+        fSize(units.size()) {
+        for (int mu=0; mu<NMEAS; mu++) fCol[mu].resize(fSize);
+        for (std::size_t i=0; i<fSize; i++) Set(i, units[i]);
+    }
+
+    void MHO_UnitArray::Resize(std::size_t size) {
+        for (int mu=0; mu<NMEAS; mu++) fCol[mu].resize(size);
+        fSize = size;
+    }
+
+    void MHO_UnitArray::Reserve(std::size_t size) {
+        for (int mu=0; mu<NMEAS; mu++) fCol[mu].reserve(size);
+    }
+
+    std::array<int8_t, NMEAS> MHO_UnitArray::Narrow(const MHO_Unit& unit) {
+        std::array<int, NMEAS> exp = unit.GetUnitExp();
+        std::array<int8_t, NMEAS> narrow;
+        for (int mu=0; mu<NMEAS; mu++) {
+            if (!Fits(exp[mu]))
+                throw std::overflow_error(
+                    "MHO_UnitArray: exponent out of the int8_t range");
+            narrow[mu] = (int8_t) exp[mu];
+        }
+        return narrow;
+    }
+
+    void MHO_UnitArray::CheckSize(const MHO_UnitArray& other) const {
+        if (other.fSize != fSize)
+            throw std::invalid_argument("MHO_UnitArray: sizes differ");
+    }
+
+    MHO_Unit MHO_UnitArray::Get(std::size_t i) const {
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = fCol[mu][i];
+        return MHO_Unit(exp);
+    }
+
+    void MHO_UnitArray::Set(std::size_t i, const MHO_Unit& unit) {
+        std::array<int8_t, NMEAS> exp = Narrow(unit);
+        for (int mu=0; mu<NMEAS; mu++) fCol[mu][i] = exp[mu];
+    }
+
+    void MHO_UnitArray::PushBack(const MHO_Unit& unit) {
+        std::array<int8_t, NMEAS> exp = Narrow(unit);
+        for (int mu=0; mu<NMEAS; mu++) fCol[mu].push_back(exp[mu]);
+        fSize++;
+    }
+
+    std::vector<MHO_Unit> MHO_UnitArray::ToUnits() const {
+        std::vector<MHO_Unit> units;
+        units.reserve(fSize);
+        for (std::size_t i=0; i<fSize; i++) units.push_back(Get(i));
+        return units;
+    }
+
+    MHO_UnitArray MHO_UnitArray::operator*(const MHO_UnitArray& other) const {
+        MHO_UnitArray res(*this);
+        return res *= other;
+    }
+
+    MHO_UnitArray MHO_UnitArray::operator/(const MHO_UnitArray& other) const {
+        MHO_UnitArray res(*this);
+        return res /= other;
+    }
+
+    MHO_UnitArray MHO_UnitArray::operator^(int power) const {
+        MHO_UnitArray res(*this);
+        return res ^= power;
+    }
+
+    // The kernels work in place, so the storage is reused
+    MHO_UnitArray& MHO_UnitArray::operator*=(const MHO_UnitArray& other) {
+        CheckSize(other);
+        bool ovf = false;
+        for (int mu=0; mu<NMEAS; mu++)
+            ovf |= Add(fCol[mu].data(), other.fCol[mu].data(),
+                       fCol[mu].data(), fSize);
+        if (ovf) Overflow();
+        return *this;
+    }
+
+    MHO_UnitArray& MHO_UnitArray::operator/=(const MHO_UnitArray& other) {
+        CheckSize(other);
+        bool ovf = false;
+        for (int mu=0; mu<NMEAS; mu++)
+            ovf |= Sub(fCol[mu].data(), other.fCol[mu].data(),
+                       fCol[mu].data(), fSize);
+        if (ovf) Overflow();
+        return *this;
+    }
+
+    MHO_UnitArray& MHO_UnitArray::operator^=(int power) {
+        bool ovf = false;
+        for (int mu=0; mu<NMEAS; mu++)
+            ovf |= Mul(fCol[mu].data(), power, fCol[mu].data(), fSize);
+        if (ovf) Overflow();
+        return *this;
+    }
+
+    std::vector<uint8_t>
+    MHO_UnitArray::EqualMask(const MHO_UnitArray& other) const {
+        CheckSize(other);
+        std::vector<uint8_t> mask(fSize, 1);
+        for (int mu=0; mu<NMEAS; mu++)
+            Eq(fCol[mu].data(), other.fCol[mu].data(), mask.data(), fSize);
+        return mask;
+    }
+
+    std::vector<uint8_t> MHO_UnitArray::EqualMask(const MHO_Unit& unit) const {
+        std::vector<uint8_t> mask(fSize, 1);
+        std::array<int, NMEAS> exp = unit.GetUnitExp();
+        for (int mu=0; mu<NMEAS; mu++) {
+            if (Fits(exp[mu]))
+                Eq(fCol[mu].data(), (int8_t) exp[mu], mask.data(), fSize);
+            else
+                mask.assign(fSize, 0);
+        }
+        return mask;
+    }
+
+    //
+    // Base slot by base slot: the projections of the elements are sums
+    // of their columns times the entries of a row of kBase, which are
+    // accumulated in int16_t from minus the target, and compared to
+    // zero. A base slot that no other symbol maps to is compared in its
+    // column, as in EqualMask(). A target that no element can reach
+    // matches none.
+    //
+    std::vector<uint8_t>
+    MHO_UnitArray::CompatibleMask(const MHO_Unit& unit) const {
+        typedef MHO_UnitDimension Dim;
+        std::vector<uint8_t> mask(fSize, 1);
+        std::array<int, NMEAS> target = Dim::Project(unit).GetUnitExp();
+        std::vector<int16_t> acc;
+        for (int nu=0; nu<NMEAS; nu++) {
+            if (!Dim::IsBase(nu)) continue;
+            int nsym = 0, reach = 0;
+            for (int mu=0; mu<NMEAS; mu++) {
+                nsym += (Dim::kBase[mu][nu] != 0);
+                reach += 128*std::abs(Dim::kBase[mu][nu]);
+            }
+            if (std::abs((long long) target[nu]) > reach) {
+                mask.assign(fSize, 0);
+                break;
+            }
+            if (nsym == 1) {
+                if (!Fits(target[nu])) {
+                    mask.assign(fSize, 0);
+                    break;
+                }
+                Eq(fCol[nu].data(), (int8_t) target[nu], mask.data(), fSize);
+                continue;
+            }
+            acc.assign(fSize, (int16_t) -target[nu]);
+            for (int mu=0; mu<NMEAS; mu++)
+                if (Dim::kBase[mu][nu])
+                    Mac(fCol[mu].data(), Dim::kBase[mu][nu], acc.data(),
+                        fSize);
+            Zero(acc.data(), mask.data(), fSize);
+        }
+        return mask;
+    }
+
+    bool MHO_UnitArray::AllCompatible(const MHO_Unit& unit) const {
+        std::vector<uint8_t> mask = CompatibleMask(unit);
+        return std::find(mask.begin(), mask.end(), 0) == mask.end();
+    }
+
+    bool MHO_UnitArray::operator==(const MHO_UnitArray& other) const {
+        if (fSize != other.fSize) return false;
+        for (int mu=0; mu<NMEAS; mu++)
+            if (!std::equal(fCol[mu].begin(), fCol[mu].begin() + fSize,
+                            other.fCol[mu].begin()))
+                return false;
+        return true;
+    }
+
+    const char* MHO_UnitArray::GetKernelName() {
+        switch (GetKernel()) {
+        case kAvx512: return "avx512";
+        case kAvx2: return "avx2";
+        default: return "scalar";
+        }
+    }
+
+}
@@ -0,0 +1,99 @@
+#ifndef MHO_UnitArray_HH__
+#define MHO_UnitArray_HH__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "read_units.h"
+#include "MHO_Unit.hh"
+
+
+namespace hops
+{
+
+    //
+    // Array of units in structure-of-arrays layout: one column of int8_t
+    // exponents per base unit, so an element takes NMEAS bytes, a
+    // quarter of the 48 bytes of int exponents that make up an MHO_Unit.
+    //
+    // The elementwise operations work column by column with SIMD kernels
+    // (AVX-512BW or AVX2 when the CPU has it, a scalar loop otherwise).
+    // As with MHO_PackedUnit, an exponent outside the int8_t range is
+    // detected: it throws std::overflow_error, and so does storing a
+    // unit with such an exponent. The compound assignments work in place
+    // on every column, and after an overflow leave each exponent that
+    // overflowed wrapped around, to the low byte of its exact value (128
+    // becomes -128), the same with every kernel; the others hold their
+    // results. The operands of the binary operations must have the same
+    // size, or std::invalid_argument is thrown.
+    //
+    class MHO_UnitArray
+    {
+    public:
+
+        MHO_UnitArray(): fSize(0) {};
+        explicit MHO_UnitArray(std::size_t size, const MHO_Unit& unit = {});
+        explicit MHO_UnitArray(std::span<const MHO_Unit> units);
+
+        std::size_t GetSize() const { return fSize; }
+        void Resize(std::size_t size);
+        void Reserve(std::size_t size);
+        void Clear() { Resize(0); }
+
+        // Element access, converting to and from MHO_Unit
+        MHO_Unit Get(std::size_t i) const;
+        void Set(std::size_t i, const MHO_Unit& unit);
+        void PushBack(const MHO_Unit& unit);
+        std::vector<MHO_Unit> ToUnits() const;
+
+        // The exponents of the base unit mu (an index of meas_tab)
+        std::span<const int8_t> GetColumn(std::size_t mu) const {
+            return std::span<const int8_t>(fCol[mu].data(), fSize);
+        }
+
+        // Elementwise algebra
+        MHO_UnitArray operator*(const MHO_UnitArray& other) const;
+        MHO_UnitArray operator/(const MHO_UnitArray& other) const;
+        MHO_UnitArray operator^(int power) const;
+        MHO_UnitArray& operator*=(const MHO_UnitArray& other);
+        MHO_UnitArray& operator/=(const MHO_UnitArray& other);
+        MHO_UnitArray& operator^=(int power);
+        void RaiseToPower(int power) { *this ^= power; }
+        void Invert() { *this ^= -1; }
+
+        // mask[i] is 1 where the elements are equal, 0 elsewhere
+        std::vector<uint8_t> EqualMask(const MHO_UnitArray& other) const;
+        std::vector<uint8_t> EqualMask(const MHO_Unit& unit) const;
+
+        // mask[i] is 1 where the element has the base dimensions of unit
+        // (see MHO_UnitDimension), so that an element "Hz" matches "s^-1"
+        std::vector<uint8_t> CompatibleMask(const MHO_Unit& unit) const;
+
+        // True if every element is compatible with unit; true for an
+        // empty array
+        bool AllCompatible(const MHO_Unit& unit) const;
+
+        bool operator==(const MHO_UnitArray& other) const;
+        bool operator!=(const MHO_UnitArray& other) const {
+            return !(*this == other);
+        }
+
+        // Name of the kernels chosen for this CPU: "avx512", "avx2",
+        // "scalar"
+        static const char* GetKernelName();
+
+    private:
+
+        std::size_t fSize;
+        std::array<std::vector<int8_t>, NMEAS> fCol;
+
+        // The exponents of unit as int8_t, or overflow_error
+        static std::array<int8_t, NMEAS> Narrow(const MHO_Unit& unit);
+        void CheckSize(const MHO_UnitArray& other) const;
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitArray_HH__ */
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include "MHO_UnitBinary.hh"
+
+
+namespace hops
+{
+
+    namespace
+    {
+        const std::size_t kExpOffset = 4;
+
+        static_assert(kExpOffset + NMEAS == MHO_UnitBinary::kRecordSize,
+                      "the exponents must fill the record");
+
+        // The first four bytes of a valid record
+        const unsigned char kHeader[kExpOffset] = {
+            MHO_UnitBinary::kVersion, NMEAS, 0, 0
+        };
+    }
+
+    const char* MHO_UnitBinary::ErrorString(Error err) {
+        switch (err) {
+        case kNone: return "no error";
+        case kOutOfRange: return "exponent out of the int8_t range";
+        case kBadVersion: return "unknown record version";
+        case kBadLayout: return "bad record layout";
+        }
+        return "unknown error";
+    }
+
+    MHO_UnitBinary::Error MHO_UnitBinary::Encode(const MHO_Unit& unit,
+                                                 char* rec) {
+        std::array<int, NMEAS> exp = unit.GetUnitExp();
+        int8_t narrow[NMEAS];
+        bool fits = true;
+        for (int mu=0; mu<NMEAS; mu++) {
+            fits &= (exp[mu] >= INT8_MIN && exp[mu] <= INT8_MAX);
+            narrow[mu] = (int8_t) exp[mu];
+        }
+        if (!fits) {
+            memset(rec, 0, kRecordSize);
+            return kOutOfRange;
+        }
+        memcpy(rec, kHeader, kExpOffset);
+        memcpy(rec + kExpOffset, narrow, NMEAS);
+        return kNone;
+    }
+
+    MHO_UnitBinary::Error MHO_UnitBinary::Decode(const char* rec,
+                                                 MHO_Unit& unit) {
+        if (memcmp(rec, kHeader, kExpOffset)) {
+            unit = MHO_Unit();
+            return ((unsigned char) rec[0] != kVersion) ? kBadVersion
+                                                        : kBadLayout;
+        }
+        int8_t narrow[NMEAS];
+        memcpy(narrow, rec + kExpOffset, NMEAS);
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = narrow[mu];
+        unit = MHO_Unit(exp);
+        return kNone;
+    }
+
+    MHO_UnitBinary::Count MHO_UnitBinary::EncodeMany(
+        std::span<const MHO_Unit> units, std::span<char> out,
+        std::span<Error> errors) {
+        std::size_t n = std::min(units.size(), out.size()/kRecordSize);
+        bool report = !errors.empty();
+        if (report) n = std::min(n, errors.size());
+        std::size_t nbad = 0;
+        for (std::size_t i=0; i<n; i++) {
+            Error err = Encode(units[i], out.data() + i*kRecordSize);
+            if (report) errors[i] = err;
+            nbad += (err != kNone);
+        }
+        return {n, nbad};
+    }
+
+    MHO_UnitBinary::Count MHO_UnitBinary::DecodeMany(
+        std::span<const char> in, std::span<MHO_Unit> units,
+        std::span<Error> errors) {
+        std::size_t n = std::min(units.size(), in.size()/kRecordSize);
+        bool report = !errors.empty();
+        if (report) n = std::min(n, errors.size());
+        std::size_t nbad = 0;
+        for (std::size_t i=0; i<n; i++) {
+            Error err = Decode(in.data() + i*kRecordSize, units[i]);
+            if (report) errors[i] = err;
+            nbad += (err != kNone);
+        }
+        return {n, nbad};
+    }
+
+}
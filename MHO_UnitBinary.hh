@@ -0,0 +1,76 @@
+#ifndef MHO_UnitBinary_HH__
+#define MHO_UnitBinary_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include "read_units.h"
+#include "MHO_Unit.hh"
+
+
+namespace hops
+{
+
+    //
+    // Binary records of units, to store with the data products instead of
+    // the unit strings, so that loading them runs no parser. A record is
+    // 16 bytes, with no alignment required:
+    //
+    //     byte 0       kVersion (1)
+    //     byte 1       NMEAS, the number of exponents (12)
+    //     bytes 2-3    zero (reserved)
+    //     bytes 4-15   the exponents of the base units, in the order of
+    //                  meas_tab, as int8_t
+    //
+    // Every record carries its version, so a file can be read at any
+    // offset, such as a field of a memory-mapped table. The bulk calls
+    // work on contiguous arrays of records; nothing is allocated, thrown
+    // or printed.
+    //
+    class MHO_UnitBinary
+    {
+    public:
+
+        static constexpr std::size_t kRecordSize = 16;
+        static constexpr uint8_t kVersion = 1;
+
+        enum Error {
+            kNone = 0,
+            kOutOfRange,   // Encode: an exponent is not an int8_t
+            kBadVersion,   // Decode: not a version we read
+            kBadLayout     // Decode: another NMEAS, or reserved bytes set
+        };
+
+        static const char* ErrorString(Error err);
+
+        // Write the record of unit to rec[0, kRecordSize). An exponent out
+        // of range writes an all-zero record (version 0, which no decoder
+        // accepts) and returns kOutOfRange.
+        static Error Encode(const MHO_Unit& unit, char* rec);
+
+        // Read the record at rec; on error, unit is dimensionless
+        static Error Decode(const char* rec, MHO_Unit& unit);
+
+        // What a bulk call did: the number of units encoded or decoded,
+        // and how many of them failed
+        struct Count {
+            std::size_t fDone;
+            std::size_t fBad;
+        };
+
+        // Encode units[i] into the records of out, or decode the records
+        // of in into units[i]. Only as many units as there are whole
+        // records (and as fit in errors, if it is given) are done, so a
+        // short buffer shows as fDone below the size expected; errors[i]
+        // gets the error of each one.
+        static Count EncodeMany(std::span<const MHO_Unit> units,
+                                std::span<char> out,
+                                std::span<Error> errors = {});
+        static Count DecodeMany(std::span<const char> in,
+                                std::span<MHO_Unit> units,
+                                std::span<Error> errors = {});
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitBinary_HH__ */
@@ -0,0 +1,168 @@
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include "MHO_UnitCache.hh"
+
+
+namespace hops
+{
+
+    namespace
+    {
+        // Hashes std::string and std::string_view alike, so the maps can
+        // be searched with a view, without making a string of it
+        struct UnitHash {
+            typedef void is_transparent;
+            std::size_t operator()(std::string_view unit) const {
+                return std::hash<std::string_view>()(unit);
+            }
+        };
+
+        typedef std::unordered_map<std::string, std::array<int, NMEAS>,
+                                   UnitHash, std::equal_to<> > UnitMap;
+
+        const std::size_t kLocalCapacity = 256; // Entries per thread
+        const uint64_t kFlushCount = 256; // Lookups between counter flushes
+
+        std::atomic<bool> gEnabled(false);
+        std::atomic<std::size_t> gCapacity(4096);
+        std::atomic<uint64_t> gGeneration(0); // Bumped by Clear()
+        std::atomic<uint64_t> gL1Hits(0);
+        std::atomic<uint64_t> gL2Hits(0);
+        std::atomic<uint64_t> gMisses(0);
+
+        std::shared_mutex gMutex;  // Guards gShared
+        UnitMap gShared;
+
+        //
+        // The thread-local level. The hit/miss counters are kept here and
+        // added to the global ones every kFlushCount lookups, so that the
+        // threads do not fight over the counters' cache line.
+        //
+        struct LocalCache {
+            UnitMap fMap;
+            uint64_t fGeneration = 0;
+            uint64_t fL1Hits = 0;
+            uint64_t fL2Hits = 0;
+            uint64_t fMisses = 0;
+            uint64_t fCount = 0;
+
+            void Flush() {
+                gL1Hits.fetch_add(fL1Hits, std::memory_order_relaxed);
+                gL2Hits.fetch_add(fL2Hits, std::memory_order_relaxed);
+                gMisses.fetch_add(fMisses, std::memory_order_relaxed);
+                fL1Hits = fL2Hits = fMisses = fCount = 0;
+            }
+
+            void Count(uint64_t& counter) {
+                counter++;
+                if (++fCount == kFlushCount) Flush();
+            }
+
+            void Put(std::string_view unit,
+                     const std::array<int, NMEAS>& exp) {
+                if (fMap.size() >= kLocalCapacity) fMap.clear();
+                fMap.emplace(std::string(unit), exp);
+            }
+
+            ~LocalCache() { Flush(); }
+        };
+
+        thread_local LocalCache tLocal;
+
+        // The calling thread's level, emptied if Clear() was called since
+        LocalCache& Local() {
+            LocalCache& lc = tLocal;
+            uint64_t gen = gGeneration.load(std::memory_order_acquire);
+            if (lc.fGeneration != gen) {
+                lc.fMap.clear();
+                lc.fL1Hits = lc.fL2Hits = lc.fMisses = lc.fCount = 0;
+                lc.fGeneration = gen;
+            }
+            return lc;
+        }
+    }
+
+
+    void MHO_UnitCache::Enable(bool enable) {
+        gEnabled.store(enable, std::memory_order_relaxed);
+    }
+
+    bool MHO_UnitCache::IsEnabled() {
+        return gEnabled.load(std::memory_order_relaxed);
+    }
+
+    void MHO_UnitCache::SetCapacity(std::size_t capacity) {
+        gCapacity.store(capacity, std::memory_order_relaxed);
+        std::unique_lock<std::shared_mutex> lock(gMutex);
+        if (gShared.size() > capacity) gShared.clear();
+    }
+
+    std::size_t MHO_UnitCache::GetCapacity() {
+        return gCapacity.load(std::memory_order_relaxed);
+    }
+
+    //
+    // Look the unit string up, first in the thread's own level, then in
+    // the shared one. A shared hit is copied to the thread's level.
+    //
+    bool MHO_UnitCache::Lookup(std::string_view unit,
+                               std::array<int, NMEAS>& exp) {
+        LocalCache& lc = Local();
+
+        auto it = lc.fMap.find(unit);
+        if (it != lc.fMap.end()) {
+            exp = it->second;
+            lc.Count(lc.fL1Hits);
+            return true;
+        }
+
+        bool found = false;
+        {
+            std::shared_lock<std::shared_mutex> lock(gMutex);
+            auto jt = gShared.find(unit);
+            if (jt != gShared.end()) {
+                exp = jt->second;
+                found = true;
+            }
+        }
+
+        if (found) {
+            lc.Put(unit, exp);
+            lc.Count(lc.fL2Hits);
+        }
+        else
+            lc.Count(lc.fMisses);
+        return found;
+    }
+
+    void MHO_UnitCache::Insert(std::string_view unit,
+                               const std::array<int, NMEAS>& exp) {
+        Local().Put(unit, exp);
+
+        std::unique_lock<std::shared_mutex> lock(gMutex);
+        if (gShared.size() >= gCapacity.load(std::memory_order_relaxed))
+            gShared.clear();
+        gShared.emplace(std::string(unit), exp);
+    }
+
+    void MHO_UnitCache::Clear() {
+        std::unique_lock<std::shared_mutex> lock(gMutex);
+        gShared.clear();
+        gL1Hits = gL2Hits = gMisses = 0;
+        gGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    MHO_UnitCache::Stats MHO_UnitCache::GetStats() {
+        Local().Flush();
+        Stats st;
+        st.fL1Hits = gL1Hits.load(std::memory_order_relaxed);
+        st.fL2Hits = gL2Hits.load(std::memory_order_relaxed);
+        st.fMisses = gMisses.load(std::memory_order_relaxed);
+        std::shared_lock<std::shared_mutex> lock(gMutex);
+        st.fSize = gShared.size();
+        return st;
+    }
+
+}
@@ -0,0 +1,61 @@
+#ifndef MHO_UnitCache_HH__
+#define MHO_UnitCache_HH__
+
+#include <string>
+#include <string_view>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "read_units.h"
+
+
+namespace hops
+{
+
+    //
+    // Optional process-wide cache of parsed unit strings: maps a unit
+    // expression string to its array of exponents, so that MHO_Unit::Parse
+    // runs the lexer and parser only once per distinct string.
+    //
+    // There are two levels. The first is thread-local and lock-free; the
+    // second is shared by all threads and guarded by a reader-writer lock
+    // (it is read-mostly). Both are bounded: a level that fills up is
+    // flushed as a whole. The cache is off until Enable() is called.
+    //
+    class MHO_UnitCache
+    {
+    public:
+
+        struct Stats {
+            uint64_t fL1Hits;   // found in the thread-local level
+            uint64_t fL2Hits;   // found in the shared level
+            uint64_t fMisses;   // not found, had to be parsed
+            std::size_t fSize;  // entries in the shared level
+        };
+
+        static void Enable(bool enable = true);
+        static bool IsEnabled();
+
+        // Bound on the number of entries in the shared level
+        static void SetCapacity(std::size_t capacity);
+        static std::size_t GetCapacity();
+
+        // Returns true and fills exp if unit is in the cache
+        static bool Lookup(std::string_view unit,
+                           std::array<int, NMEAS>& exp);
+
+        // Remember the exponents of a successfully parsed unit
+        static void Insert(std::string_view unit,
+                           const std::array<int, NMEAS>& exp);
+
+        // Drop all entries (in all threads) and zero the counters
+        static void Clear();
+
+        // The counters of other running threads are added in batches,
+        // so they may lag behind slightly
+        static Stats GetStats();
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitCache_HH__ */
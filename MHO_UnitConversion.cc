@@ -0,0 +1,269 @@
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include "MHO_UnitConversion.hh"
+#include "MHO_UnitDimension.hh"
+#include "MHO_UnitParser.hh"
+#include "MHO_UnitRegistry.hh"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MHO_UNIT_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace hops
+{
+
+    namespace
+    {
+        typedef std::array<int, NMEAS> Exp;
+
+        struct Prefix { std::string_view fSym; double fScale; };
+
+        // "da" before "d"
+        const Prefix kPrefix[] = {
+            {"Q", 1e30}, {"R", 1e27}, {"Y", 1e24}, {"Z", 1e21}, {"E", 1e18},
+            {"P", 1e15}, {"T", 1e12}, {"G", 1e9}, {"M", 1e6}, {"k", 1e3},
+            {"h", 1e2}, {"da", 1e1}, {"d", 1e-1}, {"c", 1e-2}, {"m", 1e-3},
+            {"u", 1e-6}, {"n", 1e-9}, {"p", 1e-12}, {"f", 1e-15},
+            {"a", 1e-18}, {"z", 1e-21}, {"y", 1e-24}, {"r", 1e-27},
+            {"q", 1e-30}
+        };
+
+        const int kKg = MHO_UnitParser::GetMeas("kg");
+
+        // An unprefixed symbol: the gram, or a registered unit. Degrees
+        // and janskys stay in their slots: MHO_UnitDimension has their
+        // factors.
+        bool LookupBase(const MHO_UnitRegistry* reg, std::string_view sym,
+                        Exp& exp, double& scale) {
+            if (sym == "g") {
+                exp = {};
+                exp[kKg] = 1;
+                scale = 1e-3;
+                return true;
+            }
+            scale = 1.0;
+            return reg->Lookup(sym, exp);
+        }
+
+        // MHO_UnitParser::LookupFn knowing the prefixes
+        bool LookupScaled(const void* registry, std::string_view sym,
+                          Exp& exp, double& scale) {
+            const MHO_UnitRegistry* reg =
+                static_cast<const MHO_UnitRegistry*>(registry);
+            if (LookupBase(reg, sym, exp, scale)) return true;
+            for (const Prefix& pf : kPrefix) {
+                if (sym.size() <= pf.fSym.size() ||
+                    sym.substr(0, pf.fSym.size()) != pf.fSym)
+                    continue;
+                std::string_view base = sym.substr(pf.fSym.size());
+                if (base != "kg" && LookupBase(reg, base, exp, scale)) {
+                    scale *= pf.fScale;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //
+        // The cache of conversion plans, keyed by from + '\0' + to. Only
+        // valid plans are kept. A unit registered later may change what
+        // a string means ("min" parsed as milli-"in", then "min"
+        // registered), so the plans hold for one generation of the
+        // registry, its size, which every registration increments: a
+        // plan computed with an older one is dropped.
+        //
+        const std::size_t kPlanCapacity = 4096;
+        std::shared_mutex gPlanMutex;
+        std::unordered_map<std::string, double> gPlans;
+        std::size_t gPlanGeneration = 0;
+
+        //
+        // The kernels. Each x86 variant is compiled for its own
+        // instruction set and chosen at run time from the CPU features.
+        //
+        enum Kernel { kScalar, kAvx2, kAvx512 };
+
+        template <typename T>
+        void ScaleScalar(T* v, std::size_t n, T f) {
+            for (std::size_t i=0; i<n; i++) v[i] *= f;
+        }
+
+#ifdef MHO_UNIT_X86
+        __attribute__((target("avx2")))
+        void ScaleAvx2(double* v, std::size_t n, double f) {
+            __m256d vf = _mm256_set1_pd(f);
+            std::size_t i = 0;
+            for (; i+8<=n; i+=8) {
+                __m256d a = _mm256_loadu_pd(v + i);
+                __m256d b = _mm256_loadu_pd(v + i + 4);
+                _mm256_storeu_pd(v + i, _mm256_mul_pd(a, vf));
+                _mm256_storeu_pd(v + i + 4, _mm256_mul_pd(b, vf));
+            }
+            ScaleScalar(v + i, n - i, f);
+        }
+
+        __attribute__((target("avx2")))
+        void ScaleAvx2(float* v, std::size_t n, float f) {
+            __m256 vf = _mm256_set1_ps(f);
+            std::size_t i = 0;
+            for (; i+16<=n; i+=16) {
+                __m256 a = _mm256_loadu_ps(v + i);
+                __m256 b = _mm256_loadu_ps(v + i + 8);
+                _mm256_storeu_ps(v + i, _mm256_mul_ps(a, vf));
+                _mm256_storeu_ps(v + i + 8, _mm256_mul_ps(b, vf));
+            }
+            ScaleScalar(v + i, n - i, f);
+        }
+
+        // The tail is done with a masked load and store
+        __attribute__((target("avx512f")))
+        void ScaleAvx512(double* v, std::size_t n, double f) {
+            __m512d vf = _mm512_set1_pd(f);
+            std::size_t i = 0;
+            for (; i+8<=n; i+=8)
+                _mm512_storeu_pd(v + i,
+                                 _mm512_mul_pd(_mm512_loadu_pd(v + i), vf));
+            if (i < n) {
+                __mmask8 m = (__mmask8) ((1u << (n - i)) - 1);
+                __m512d a = _mm512_maskz_loadu_pd(m, v + i);
+                _mm512_mask_storeu_pd(v + i, m, _mm512_mul_pd(a, vf));
+            }
+        }
+
+        __attribute__((target("avx512f")))
+        void ScaleAvx512(float* v, std::size_t n, float f) {
+            __m512 vf = _mm512_set1_ps(f);
+            std::size_t i = 0;
+            for (; i+16<=n; i+=16)
+                _mm512_storeu_ps(v + i,
+                                 _mm512_mul_ps(_mm512_loadu_ps(v + i), vf));
+            if (i < n) {
+                __mmask16 m = (__mmask16) ((1u << (n - i)) - 1);
+                __m512 a = _mm512_maskz_loadu_ps(m, v + i);
+                _mm512_mask_storeu_ps(v + i, m, _mm512_mul_ps(a, vf));
+            }
+        }
+#endif
+
+        Kernel GetKernel() {
+            static const Kernel kernel = [] {
+#ifdef MHO_UNIT_X86
+                __builtin_cpu_init();
+                if (__builtin_cpu_supports("avx512f")) return kAvx512;
+                if (__builtin_cpu_supports("avx2")) return kAvx2;
+#endif
+                return kScalar;
+            }();
+            return kernel;
+        }
+
+        template <typename T>
+        void ScaleAny(T* v, std::size_t n, T f) {
+            switch (GetKernel()) {
+#ifdef MHO_UNIT_X86
+            case kAvx512: ScaleAvx512(v, n, f); return;
+            case kAvx2: ScaleAvx2(v, n, f); return;
+#endif
+            default: ScaleScalar(v, n, f); return;
+            }
+        }
+    }
+
+
+    bool MHO_UnitConversion::ParseScaled(std::string_view unit, Exp& exp,
+                                         double& scale) {
+        MHO_UnitParser parser(unit);
+        parser.SetLookup(LookupScaled, &MHO_UnitRegistry::GetInstance());
+        MHO_UnitParser::Result res = parser.Parse();
+        exp = res.fExp;
+        scale = res.fScale;
+        return res.Ok();
+    }
+
+    MHO_UnitConversion::MHO_UnitConversion(std::string_view from,
+                                           std::string_view to):
+        fFactor(0.0), fValid(false) {
+        std::string key;
+        key.reserve(from.size() + to.size() + 1);
+        key.append(from).push_back('\0');
+        key.append(to);
+        // Read before the parse, so a registration during it makes the
+        // plan stale
+        std::size_t gen = MHO_UnitRegistry::GetInstance().GetSize();
+        {
+            std::shared_lock<std::shared_mutex> lock(gPlanMutex);
+            auto it = gPlans.find(key);
+            if (it != gPlans.end() && gen == gPlanGeneration) {
+                fFactor = it->second;
+                fValid = true;
+                return;
+            }
+        }
+
+        Exp efrom, eto;
+        double sfrom, sto;
+        if (!ParseScaled(from, efrom, sfrom) || !ParseScaled(to, eto, sto))
+            return;
+        MHO_Unit ufrom(efrom), uto(eto);
+        if (!MHO_UnitDimension::Compatible(ufrom, uto)) return;
+        fFactor = sfrom/sto*MHO_UnitDimension::GetFactor(ufrom, uto);
+        fValid = true;
+
+        std::unique_lock<std::shared_mutex> lock(gPlanMutex);
+        if (gen < gPlanGeneration) return;
+        if (gen > gPlanGeneration || gPlans.size() >= kPlanCapacity) {
+            gPlans.clear();
+            gPlanGeneration = gen;
+        }
+        gPlans.emplace(std::move(key), fFactor);
+    }
+
+    bool MHO_UnitConversion::Apply(std::span<double> values) const {
+        if (!fValid) return false;
+        if (fFactor != 1.0) Scale(values, fFactor);
+        return true;
+    }
+
+    bool MHO_UnitConversion::Apply(std::span<float> values) const {
+        if (!fValid) return false;
+        if (fFactor != 1.0) Scale(values, (float) fFactor);
+        return true;
+    }
+
+    bool MHO_UnitConversion::Convert(std::string_view from,
+                                     std::string_view to,
+                                     std::span<double> values) {
+        return MHO_UnitConversion(from, to).Apply(values);
+    }
+
+    bool MHO_UnitConversion::Convert(std::string_view from,
+                                     std::string_view to,
+                                     std::span<float> values) {
+        return MHO_UnitConversion(from, to).Apply(values);
+    }
+
+    void MHO_UnitConversion::Scale(std::span<double> values, double factor) {
+        ScaleAny(values.data(), values.size(), factor);
+    }
+
+    void MHO_UnitConversion::Scale(std::span<float> values, float factor) {
+        ScaleAny(values.data(), values.size(), factor);
+    }
+
+    const char* MHO_UnitConversion::GetKernelName() {
+        switch (GetKernel()) {
+        case kAvx512: return "avx512";
+        case kAvx2: return "avx2";
+        default: return "scalar";
+        }
+    }
+
+    void MHO_UnitConversion::ClearCache() {
+        std::unique_lock<std::shared_mutex> lock(gPlanMutex);
+        gPlans.clear();
+    }
+
+}
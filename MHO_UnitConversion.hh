@@ -0,0 +1,82 @@
+#ifndef MHO_UnitConversion_HH__
+#define MHO_UnitConversion_HH__
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include "read_units.h"
+
+
+namespace hops
+{
+
+    //
+    // Conversion of arrays of values between units of the same dimension,
+    // such as "MHz" to "Hz", "deg" to "rad" or "mJy" to "Jy".
+    //
+    // Here the unit expressions are scale-aware: every symbol known to the
+    // MHO_UnitRegistry may take an SI prefix (from "q", 1e-30, to "Q",
+    // 1e30, with "u" for micro and "da" for deca), "g" is 1e-3 kg, and
+    // "deg" is pi/180 "rad". A symbol that is registered as it stands is
+    // never split into a prefix, so "cd" stays the candela and "mol" the
+    // mole. (MHO_Unit itself carries no scale, and does not accept the
+    // prefixed symbols.)
+    //
+    // Constructing an MHO_UnitConversion checks the two units for the same
+    // base dimensions (see MHO_UnitDimension), so that "Hz" converts to
+    // "s^-1" and "Jy" to "kg*s^-2", and computes the factor once; the
+    // result is cached, keyed by the two strings, so a repeated conversion
+    // parses nothing. Apply() multiplies the values in place by the
+    // factor, with an AVX-512 or AVX2 kernel when the CPU has it and a
+    // scalar loop otherwise.
+    //
+    class MHO_UnitConversion
+    {
+    public:
+
+        MHO_UnitConversion(std::string_view from, std::string_view to);
+
+        // False if either unit does not parse or the dimensions differ
+        bool IsValid() const { return fValid; }
+
+        // Values in from times the factor are values in to
+        double GetFactor() const { return fFactor; }
+
+        // Convert the values in place; false (and nothing done) if invalid
+        bool Apply(std::span<double> values) const;
+        bool Apply(std::span<float> values) const;
+
+        // One-shot conversions
+        static bool Convert(std::string_view from, std::string_view to,
+                            std::span<double> values);
+        static bool Convert(std::string_view from, std::string_view to,
+                            std::span<float> values);
+
+        // Parse a scale-aware unit expression into the exponents of the
+        // symbols of meas_tab and the factor of its prefixes and grams
+        // (that of "deg" and "Jy" is MHO_UnitDimension::GetScale());
+        // false on any error
+        static bool ParseScaled(std::string_view unit,
+                                std::array<int, NMEAS>& exp, double& scale);
+
+        // The kernels: values[i] *= factor
+        static void Scale(std::span<double> values, double factor);
+        static void Scale(std::span<float> values, float factor);
+
+        // Name of the kernel chosen for this CPU: "avx512", "avx2", "scalar"
+        static const char* GetKernelName();
+
+        // Drop the cached conversion plans
+        static void ClearCache();
+
+    private:
+
+        double fFactor;
+        bool fValid;
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitConversion_HH__ */
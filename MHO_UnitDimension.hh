@@ -0,0 +1,175 @@
+#ifndef MHO_UnitDimension_HH__
+#define MHO_UnitDimension_HH__
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include "read_units.h"
+#include "MHO_Unit.hh"
+#include "MHO_UnitParser.hh"
+
+
+namespace hops
+{
+
+    //
+    // Projection of units onto the base dimensions: the seven of SI (m,
+    // kg, s, A, K, cd, mol) and the plane angle, in rad. meas_tab keeps
+    // "Hz", "deg", "sr" and "Jy" in slots of their own, so that a unit
+    // is written back as it was parsed; the projection replaces each of
+    // them by its value in the base slots: Hz by s^-1, deg by rad, sr by
+    // rad^2, and Jy (1e-26 W m^-2 Hz^-1) by kg s^-2. Two units are
+    // compatible, that is, convertible into each other by a factor, if
+    // their projections are equal.
+    //
+    // The projection is a constant integer matrix, kBase, whose column mu
+    // holds the exponents of the symbol mu in the base slots; the factors
+    // of deg and Jy are kept apart, in kScale. As the base slots map to
+    // themselves, projecting a unit takes only the few products of the
+    // other columns, unrolled at compile time, and is constexpr. Unlike
+    // SI, the plane angle is kept as a dimension, or rad, sr and the plain
+    // numbers would all be compatible.
+    //
+    class MHO_UnitDimension
+    {
+    public:
+
+        typedef std::array<int, NMEAS> Exp;
+
+        static constexpr std::array<Exp, NMEAS> kBase = [] {
+            std::array<Exp, NMEAS> base{};
+            for (int mu=0; mu<NMEAS; mu++) base[mu][mu] = 1;
+            base[i_freq] = {};
+            base[i_freq][i_time] = -1;
+            base[i_ang_deg] = {};
+            base[i_ang_deg][i_ang_rad] = 1;
+            base[i_solid_ang] = {};
+            base[i_solid_ang][i_ang_rad] = 2;
+            base[i_Jansky] = {};
+            base[i_Jansky][i_mass] = 1;
+            base[i_Jansky][i_time] = -2;
+            return base;
+        }();
+
+        static constexpr std::array<double, NMEAS> kScale = [] {
+            std::array<double, NMEAS> scale{};
+            for (int mu=0; mu<NMEAS; mu++) scale[mu] = 1.0;
+            scale[i_ang_deg] = 3.14159265358979323846/180;
+            scale[i_Jansky] = 1e-26;
+            return scale;
+        }();
+
+        static_assert(MHO_UnitParser::kMeasTab[i_time] == "s" &&
+                      MHO_UnitParser::kMeasTab[i_freq] == "Hz" &&
+                      MHO_UnitParser::kMeasTab[i_ang_deg] == "deg" &&
+                      MHO_UnitParser::kMeasTab[i_solid_ang] == "sr" &&
+                      MHO_UnitParser::kMeasTab[i_Jansky] == "Jy",
+                      "kBase must follow meas_tab");
+
+        // True for the slots of the base dimensions, which kBase keeps
+        static constexpr std::array<bool, NMEAS> kIsBase = [] {
+            std::array<bool, NMEAS> is{};
+            for (int mu=0; mu<NMEAS; mu++) {
+                Exp unit{};
+                unit[mu] = 1;
+                is[mu] = (kBase[mu] == unit);
+            }
+            return is;
+        }();
+
+        static constexpr bool IsBase(int mu) noexcept { return kIsBase[mu]; }
+
+    private:
+
+        // The entries of kBase off the identity, (mu, nu, kBase[mu][nu])
+        // for the symbols mu that are not base slots: the only products
+        // of a projection, few enough to be unrolled
+        struct Term { int fMu, fNu, fExp; };
+
+        static constexpr int kNTerms = [] {
+            int n = 0;
+            for (int mu=0; mu<NMEAS; mu++)
+                for (int nu=0; nu<NMEAS; nu++)
+                    n += (!kIsBase[mu] && kBase[mu][nu] != 0);
+            return n;
+        }();
+
+        static constexpr std::array<Term, kNTerms> kTerms = [] {
+            std::array<Term, kNTerms> terms{};
+            int n = 0;
+            for (int mu=0; mu<NMEAS; mu++)
+                for (int nu=0; nu<NMEAS; nu++)
+                    if (!kIsBase[mu] && kBase[mu][nu] != 0)
+                        terms[n++] = Term{mu, nu, kBase[mu][nu]};
+            return terms;
+        }();
+
+        // All ones in the base slots, zero in the others
+        static constexpr Exp kKeep = [] {
+            Exp keep{};
+            for (int mu=0; mu<NMEAS; mu++) keep[mu] = kIsBase[mu] ? ~0 : 0;
+            return keep;
+        }();
+
+        // The other slots are masked out, with no branch, and the terms
+        // are added as constants
+        template <std::size_t... K>
+        static constexpr Exp Project(const Exp& exp,
+                                     std::index_sequence<K...>) noexcept {
+            Exp dim;
+            for (int mu=0; mu<NMEAS; mu++) dim[mu] = exp[mu] & kKeep[mu];
+            ((dim[kTerms[K].fNu] += kTerms[K].fExp*exp[kTerms[K].fMu]), ...);
+            return dim;
+        }
+
+        static constexpr Exp Project(const Exp& exp) noexcept {
+            return Project(exp, std::make_index_sequence<kNTerms>());
+        }
+
+    public:
+
+        // The unit in the base slots only: "Jy*Hz^-1" gives "kg*s^-1"
+        static constexpr MHO_Unit Project(const MHO_Unit& unit) noexcept {
+            return MHO_Unit(Project(unit.GetUnitExp()));
+        }
+
+        // The factor from unit to its projection: 1e-26 for "Jy"
+        static constexpr double GetScale(const MHO_Unit& unit) noexcept {
+            Exp exp = unit.GetUnitExp();
+            double scale = 1.0;
+            for (int mu=0; mu<NMEAS; mu++) {
+                if (kScale[mu] == 1.0) continue;
+                // By squaring; a negative power divides
+                double x = kScale[mu], p = 1.0;
+                for (unsigned n = (exp[mu] < 0) ? -(unsigned) exp[mu]
+                                                : (unsigned) exp[mu];
+                     n; n >>= 1, x *= x)
+                    if (n & 1) p *= x;
+                scale = (exp[mu] < 0) ? scale/p : scale*p;
+            }
+            return scale;
+        }
+
+        // The projection is linear: that of a/b must be zero, which is
+        // tested without a branch
+        static constexpr bool Compatible(const MHO_Unit& a,
+                                         const MHO_Unit& b) noexcept {
+            Exp ea = a.GetUnitExp(), eb = b.GetUnitExp();
+            for (int mu=0; mu<NMEAS; mu++) ea[mu] -= eb[mu];
+            Exp dim = Project(ea);
+            int any = 0;
+            for (int mu=0; mu<NMEAS; mu++) any |= dim[mu];
+            return any == 0;
+        }
+
+        // Values in a times the factor are values in b, if they are
+        // compatible
+        static constexpr double GetFactor(const MHO_Unit& a,
+                                          const MHO_Unit& b) noexcept {
+            return GetScale(a)/GetScale(b);
+        }
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitDimension_HH__ */
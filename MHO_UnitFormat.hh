@@ -0,0 +1,52 @@
+#ifndef MHO_UnitFormat_HH__
+#define MHO_UnitFormat_HH__
+
+//
+// Formatters of MHO_Unit for std::format (where the library has it) and
+// for the fmt library (if it is included before this header):
+//
+//     std::format("{:>20}", unit)      fmt::format("{}", unit)
+//
+// The unit is written by MHO_Unit::ToChars into a buffer on the stack
+// and copied to the output, with no heap allocation. The format spec is
+// that of a string ("{:<12}", "{:^20}", ...).
+//
+
+#include "MHO_Unit.hh"
+
+#if __has_include(<format>)
+#include <format>
+#endif
+
+#if defined(__cpp_lib_format)
+template <>
+struct std::formatter<hops::MHO_Unit, char>:
+    std::formatter<std::string_view, char>
+{
+    template <typename FormatContext>
+    auto format(const hops::MHO_Unit& unit, FormatContext& ctx) const {
+        char buf[hops::MHO_Unit::kMaxChars];
+        std::to_chars_result res =
+            unit.ToChars(buf, buf + hops::MHO_Unit::kMaxChars);
+        return std::formatter<std::string_view, char>::format(
+            std::string_view(buf, res.ptr - buf), ctx);
+    }
+};
+#endif
+
+#if defined(FMT_VERSION)
+template <>
+struct fmt::formatter<hops::MHO_Unit>: fmt::formatter<fmt::string_view>
+{
+    template <typename FormatContext>
+    auto format(const hops::MHO_Unit& unit, FormatContext& ctx) const {
+        char buf[hops::MHO_Unit::kMaxChars];
+        std::to_chars_result res =
+            unit.ToChars(buf, buf + hops::MHO_Unit::kMaxChars);
+        return fmt::formatter<fmt::string_view>::format(
+            fmt::string_view(buf, res.ptr - buf), ctx);
+    }
+};
+#endif
+
+#endif /* end of include guard: MHO_UnitFormat_HH__ */
@@ -0,0 +1,145 @@
+#include <stdexcept>
+#include "MHO_UnitIntern.hh"
+
+
+namespace hops
+{
+
+    MHO_UnitIntern& MHO_UnitIntern::GetInstance() {
+        static MHO_UnitIntern intern;
+        return intern;
+    }
+
+    MHO_UnitIntern::Table::Table(std::size_t capacity):
+        fMask(capacity - 1),
+        fSlot(new std::atomic<const Entry*>[capacity]) {
+        for (std::size_t i=0; i<capacity; i++)
+            fSlot[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    MHO_UnitIntern::MHO_UnitIntern():
+        fTable(nullptr), fSize(0), fMemo(new MemoSlot[kMemoSize]) {
+        for (auto& chunk : fChunk)
+            chunk.store(nullptr, std::memory_order_relaxed);
+        for (std::size_t i=0; i<kMemoSize; i++) {
+            fMemo[i].fKey.store(0, std::memory_order_relaxed);
+            fMemo[i].fId.store(kNoId, std::memory_order_relaxed);
+        }
+        fTables.emplace_back(new Table(1024));
+        fTable.store(fTables.back().get(), std::memory_order_release);
+        Intern(MHO_Unit());
+    }
+
+    MHO_UnitIntern::~MHO_UnitIntern() {
+        for (auto& chunk : fChunk) delete[] chunk.load();
+    }
+
+    const MHO_UnitIntern::Entry*
+    MHO_UnitIntern::Find(const Table* table, const MHO_Unit& unit,
+                         uint64_t hash) const {
+        for (std::size_t i=hash & table->fMask; ; i=(i + 1) & table->fMask) {
+            const Entry* entry =
+                table->fSlot[i].load(std::memory_order_acquire);
+            if (!entry) return nullptr;
+            if (entry->fHash == hash && entry->fUnit == unit) return entry;
+        }
+    }
+
+    // Writers only; the table is never full (load factor <= 1/2)
+    void MHO_UnitIntern::Put(Table* table, const Entry* entry) {
+        std::size_t i = entry->fHash & table->fMask;
+        while (table->fSlot[i].load(std::memory_order_relaxed))
+            i = (i + 1) & table->fMask;
+        table->fSlot[i].store(entry, std::memory_order_release);
+    }
+
+    bool MHO_UnitIntern::Find(const MHO_Unit& unit, MHO_UnitId& id) const {
+        const Entry* entry = Find(fTable.load(std::memory_order_acquire),
+                                  unit, unit.Hash());
+        if (!entry) return false;
+        id = entry->fId;
+        return true;
+    }
+
+    MHO_UnitId MHO_UnitIntern::Intern(const MHO_Unit& unit) {
+        uint64_t hash = unit.Hash();
+        if (const Entry* entry =
+                Find(fTable.load(std::memory_order_acquire), unit, hash))
+            return entry->fId;
+
+        std::lock_guard<std::mutex> lock(fMutex);
+        Table* table = fTables.back().get();
+        if (const Entry* entry = Find(table, unit, hash))
+            return entry->fId;  // Interned meanwhile
+
+        std::size_t size = fSize.load(std::memory_order_relaxed);
+        if (size >= kMaxSize)
+            throw std::length_error("MHO_UnitIntern: too many units");
+
+        // Grow: fill a table twice as big, then publish it
+        if (2*(size + 1) > table->fMask + 1) {
+            std::unique_ptr<Table> bigger(new Table(2*(table->fMask + 1)));
+            for (std::size_t id=0; id<size; id++)
+                Put(bigger.get(), &GetEntry((MHO_UnitId) id));
+            fTables.push_back(std::move(bigger));
+            table = fTables.back().get();
+            fTable.store(table, std::memory_order_release);
+        }
+
+        std::atomic<Entry*>& slot = fChunk[size >> kChunkBits];
+        Entry* chunk = slot.load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = new Entry[1u << kChunkBits];
+            slot.store(chunk, std::memory_order_release);
+        }
+        Entry& entry = chunk[size & ((1u << kChunkBits) - 1)];
+        entry.fUnit = unit;
+        entry.fString = unit.GetUnitString();
+        entry.fHash = hash;
+        entry.fId = (MHO_UnitId) size;
+        Put(table, &entry);
+        fSize.store(size + 1, std::memory_order_release);
+        return entry.fId;
+    }
+
+    //
+    // A slot is claimed by a CAS of its key from 0 and then given its
+    // result, so a reader that finds the key with no result yet, or no
+    // free slot in the probe window, computes the result itself. The
+    // results are the same from any thread, as the IDs are.
+    //
+    MHO_UnitId MHO_UnitIntern::MemoMiss(Op op, MHO_UnitId a, uint32_t b,
+                                        uint64_t key) {
+        std::size_t i = MemoHome(key);
+        MemoSlot* claimed = nullptr;
+        for (std::size_t k=0; k<kMemoProbes; k++) {
+            MemoSlot& slot = fMemo[(i + k) & (kMemoSize - 1)];
+            uint64_t cur = slot.fKey.load(std::memory_order_acquire);
+            if (cur == key) {
+                MHO_UnitId id = slot.fId.load(std::memory_order_acquire);
+                if (id != kNoId) return id;
+                break;  // Being filled in by another thread
+            }
+            if (cur == 0) {
+                if (slot.fKey.compare_exchange_strong(
+                        cur, key, std::memory_order_acq_rel)) {
+                    claimed = &slot;
+                    break;
+                }
+                if (cur == key) break;
+            }
+        }
+
+        const MHO_Unit& ua = GetUnit(a);
+        MHO_Unit res;
+        switch (op) {
+        case kMul: res = ua * GetUnit(b); break;
+        case kDiv: res = ua / GetUnit(b); break;
+        case kPow: res = ua ^ (int) b; break;
+        }
+        MHO_UnitId id = Intern(res);
+        if (claimed) claimed->fId.store(id, std::memory_order_release);
+        return id;
+    }
+
+}
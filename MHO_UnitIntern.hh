@@ -0,0 +1,163 @@
+#ifndef MHO_UnitIntern_HH__
+#define MHO_UnitIntern_HH__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "MHO_Unit.hh"
+
+
+namespace hops
+{
+
+    // The ID of an interned unit: equal IDs are equal units
+    typedef uint32_t MHO_UnitId;
+
+    //
+    // Interning table of units: every distinct unit gets a small integer
+    // ID, so that containers can store the IDs instead of the units and
+    // compare units as integers. The canonical string of each unit is
+    // built once, when it is interned. ID 0 is the dimensionless unit.
+    //
+    // As in the MHO_UnitRegistry, the units are found by hash in an
+    // open-addressing table that readers probe without any lock, and
+    // that is replaced as a whole by a bigger copy when it fills up; the
+    // retired tables are kept until the table dies. The entries live in
+    // chunks that never move, so GetUnit() and GetString() are lock-free
+    // as well. Interning a new unit takes a mutex. The IDs are dense,
+    // in the order of interning, up to kMaxSize units.
+    //
+    // The algebra of the IDs, Multiply(), Divide() and Power(), is
+    // memoized: each result is computed and interned once, then read
+    // back from a flat table of kMemoSize slots with a single probe in
+    // the common case. The slots are claimed without locks and never
+    // change afterwards; when the probe window of an operation is full,
+    // its result is just computed.
+    //
+    class MHO_UnitIntern
+    {
+    public:
+
+        static constexpr std::size_t kChunkBits = 10;
+        static constexpr std::size_t kMaxChunks = 4096;
+        static constexpr std::size_t kMaxSize = kMaxChunks << kChunkBits;
+        static constexpr std::size_t kMemoSize = 1 << 16;
+
+        static MHO_UnitIntern& GetInstance();
+
+        MHO_UnitIntern();
+        ~MHO_UnitIntern();
+        MHO_UnitIntern(const MHO_UnitIntern&) = delete;
+        MHO_UnitIntern& operator=(const MHO_UnitIntern&) = delete;
+
+        // The ID of unit, interning it if it is new; throws
+        // std::length_error if kMaxSize units are interned already
+        MHO_UnitId Intern(const MHO_Unit& unit);
+
+        // Returns true and sets id if unit is interned
+        bool Find(const MHO_Unit& unit, MHO_UnitId& id) const;
+
+        // The unit and its string of an ID returned by Intern() or Find()
+        const MHO_Unit& GetUnit(MHO_UnitId id) const {
+            return GetEntry(id).fUnit;
+        }
+        const std::string& GetString(MHO_UnitId id) const {
+            return GetEntry(id).fString;
+        }
+
+        std::size_t GetSize() const {
+            return fSize.load(std::memory_order_acquire);
+        }
+
+        // The IDs of a*b, a/b and a^power, memoized; throw like Intern()
+        MHO_UnitId Multiply(MHO_UnitId a, MHO_UnitId b) {
+            return Memo(kMul, a, b);
+        }
+        MHO_UnitId Divide(MHO_UnitId a, MHO_UnitId b) {
+            return Memo(kDiv, a, b);
+        }
+        MHO_UnitId Power(MHO_UnitId a, int power) {
+            return Memo(kPow, a, (uint32_t) power);
+        }
+
+    private:
+
+        struct Entry {
+            MHO_Unit fUnit;
+            std::string fString;
+            uint64_t fHash;
+            MHO_UnitId fId;
+        };
+
+        enum Op { kMul = 1, kDiv, kPow };
+
+        // A memoized result: fKey is (op, a, b or power), 0 if the slot
+        // is free; fId is set after fKey is claimed, kNoId until then
+        struct MemoSlot {
+            std::atomic<uint64_t> fKey;
+            std::atomic<MHO_UnitId> fId;
+        };
+        static constexpr MHO_UnitId kNoId = ~(MHO_UnitId) 0;
+        static constexpr std::size_t kMemoProbes = 8;
+
+        struct Table {
+            std::size_t fMask;  // Capacity - 1, a power of two
+            std::unique_ptr<std::atomic<const Entry*>[]> fSlot;
+            explicit Table(std::size_t capacity);
+        };
+
+        const Entry& GetEntry(MHO_UnitId id) const {
+            const Entry* chunk =
+                fChunk[id >> kChunkBits].load(std::memory_order_acquire);
+            return chunk[id & ((1u << kChunkBits) - 1)];
+        }
+
+        const Entry* Find(const Table* table, const MHO_Unit& unit,
+                          uint64_t hash) const;
+        static void Put(Table* table, const Entry* entry);
+
+        //
+        // The key is op:2 | a:30 | b:32 (the IDs are below 2^22), never 0;
+        // its home slot is the top bits of a multiplicative hash. A hit
+        // in the home slot is answered inline, the rest by MemoMiss().
+        //
+        static constexpr int kMemoBits = 16;
+        static_assert(kMemoSize == std::size_t(1) << kMemoBits,
+                      "kMemoSize must be 2^kMemoBits");
+
+        static uint64_t MemoKey(Op op, MHO_UnitId a, uint32_t b) {
+            return (uint64_t) op << 62 | (uint64_t) a << 32 | b;
+        }
+
+        static std::size_t MemoHome(uint64_t key) {
+            return (key * 0x9e3779b97f4a7c15ULL) >> (64 - kMemoBits);
+        }
+
+        MHO_UnitId Memo(Op op, MHO_UnitId a, uint32_t b) {
+            uint64_t key = MemoKey(op, a, b);
+            const MemoSlot& slot = fMemo[MemoHome(key)];
+            if (slot.fKey.load(std::memory_order_acquire) == key) {
+                MHO_UnitId id = slot.fId.load(std::memory_order_acquire);
+                if (id != kNoId) return id;
+            }
+            return MemoMiss(op, a, b, key);
+        }
+
+        MHO_UnitId MemoMiss(Op op, MHO_UnitId a, uint32_t b, uint64_t key);
+
+        std::atomic<const Table*> fTable;
+        std::atomic<std::size_t> fSize;
+        std::mutex fMutex;  // Serializes the writers
+        std::vector<std::unique_ptr<Table> > fTables; // Current and retired
+        std::array<std::atomic<Entry*>, kMaxChunks> fChunk;
+        std::unique_ptr<MemoSlot[]> fMemo;
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitIntern_HH__ */
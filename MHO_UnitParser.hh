@@ -0,0 +1,485 @@
+#ifndef MHO_UnitParser_HH__
+#define MHO_UnitParser_HH__
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+#include "read_units.h"
+
+
+namespace hops
+{
+
+    //
+    // Recursive-descent parser for the grammar of read_units.y. Everything
+    // is constexpr, so a unit expression known at compile time is reduced
+    // to its array of exponents by the compiler (see the _unit literal in
+    // MHO_Unit.hh). It works on a std::string_view and uses no heap,
+    // unless the parentheses of the units nest more than 8 deep, when
+    // the frames of the deeper ones go to a std::vector (see FrameStack).
+    //
+    // The Flex scanner reports and skips illegal characters. This parser
+    // treats them as errors, unless skip_illegal is set, when it skips them
+    // silently, so as to accept exactly what Flex and Bison accept.
+    //
+    // Alongside the exponents, the parser multiplies out the scale factors
+    // the lookup gives the symbols (1 for the base units), so that with
+    // a lookup that knows prefixes "MHz^2" comes out as Hz^2 and 1e12.
+    //
+    // The unit expressions are parsed with an explicit stack of the open
+    // parentheses, so their nesting takes no C stack and the time is
+    // linear in the length. The integer exponent expressions are parsed
+    // recursively, and their nesting is limited to kMaxDepth (which the
+    // Flex/Bison engine does not limit). Their arithmetic is checked, and
+    // so are the powers and products of the unit exponents: a value out
+    // of the int range, a number literal included, is the error kOverflow,
+    // as it is "exponent overflow" in read_units.y.
+    //
+    class MHO_UnitParser
+    {
+    public:
+
+        enum Error {
+            kNone = 0,
+            kEmpty,          // nothing but white space
+            kNumberOnly,     // no measurement units, just number
+            kUnknownSymbol,  // no such measurement unit
+            kIllegalChar,
+            kDivByZero,      // in an integer exponent expression
+            kTooDeep,        // exponent expression nested over kMaxDepth
+            kOverflow,       // integer exponent out of the int range
+            kSyntax
+        };
+
+        static constexpr int kMaxDepth = 256;
+
+        struct Result {
+            std::array<int, NMEAS> fExp;
+            double fScale;        // Product of the scales of the symbols
+            Error fError;
+            std::size_t fOffset;  // Byte offset of the error in the input
+            constexpr bool Ok() const { return fError == kNone; }
+        };
+
+        // Symbols of the measurement units, in the order of meas_tab. They
+        // are fixed: the registry starts from them, and MHO_Unit::ToChars()
+        // writes them, so no registration renames a base unit.
+        static constexpr std::string_view kMeasTab[NMEAS] =
+            {"m", "kg", "s", "A", "K", "cd", "mol", "Hz", "rad", "deg", "sr",
+             "Jy"};
+
+        // Run-time symbol lookup, such as that of MHO_UnitRegistry: sets
+        // exp to the powers of sym and scale to its size in terms of them,
+        // and returns true if sym is known
+        typedef bool (*LookupFn)(const void* registry, std::string_view sym,
+                                 std::array<int, NMEAS>& exp, double& scale);
+
+        constexpr explicit MHO_UnitParser(std::string_view str,
+                                          bool skip_illegal = false):
+            fStr(str), fPos(0), fTok(kEnd), fTokPos(0), fNum(0),
+            fError(kNone), fErrPos(0), fSkipIllegal(skip_illegal),
+            fDepth(0), fLookup(nullptr), fRegistry(nullptr) {};
+
+        // Without a lookup, only the base units of kMeasTab are known
+        constexpr void SetLookup(LookupFn lookup, const void* registry) {
+            fLookup = lookup;
+            fRegistry = registry;
+        }
+
+        constexpr Result Parse() {
+            Result res {{}, 1.0, kNone, 0};
+            Advance();
+            if (fTok == kEnd)
+                Fail(kEmpty, fTokPos);
+            else if (fTok == kNumber || fTok == '+' || fTok == '-') {
+                int num = 0;
+                if (NumExpr(num)) {
+                    if (fTok == kEnd) Fail(kNumberOnly, 0);
+                    else Fail(kSyntax, fTokPos);
+                }
+            }
+            else if (SymExpr(res.fExp, res.fScale) && fTok != kEnd)
+                Fail(kSyntax, fTokPos);
+
+            if (fError != kNone) {
+                res.fExp = {};
+                res.fScale = 1.0;
+                res.fError = fError;
+                res.fOffset = fErrPos;
+            }
+            return res;
+        }
+
+        static constexpr const char* ErrorString(Error err) {
+            switch (err) {
+            case kNone: return "no error";
+            case kEmpty: return "empty string";
+            case kNumberOnly: return "no measurement units, just number";
+            case kUnknownSymbol: return "no such measurement unit";
+            case kIllegalChar: return "illegal character";
+            case kDivByZero: return "division by zero";
+            case kTooDeep: return "exponent nested too deeply";
+            case kOverflow: return "exponent overflow";
+            default: return "syntax error";
+            }
+        }
+
+        // Index of the measurement unit sym in kMeasTab, or -1
+        static constexpr int GetMeas(std::string_view sym) {
+            for (int mu=0; mu<NMEAS; mu++)
+                if (kMeasTab[mu] == sym) return mu;
+            return -1;
+        }
+
+    private:
+
+        typedef std::array<int, NMEAS> Exp;
+
+        // Token codes other than the single character operators
+        enum { kEnd = 0, kNumber = 256, kSymbol, kBad };
+
+        std::string_view fStr;
+        std::size_t fPos;      // Scan position
+        int fTok;              // Current token
+        std::size_t fTokPos;   // and its offset
+        int fNum;              // Value of kNumber
+        std::string_view fSym; // Text of kSymbol
+        Error fError;
+        std::size_t fErrPos;
+        bool fSkipIllegal;
+        int fDepth;            // Of the exponent expression recursion
+        LookupFn fLookup;
+        const void* fRegistry;
+
+        static constexpr bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+        static constexpr bool IsAlpha(char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        }
+
+        // Keep the first error; the kBad token stops all the loops
+        constexpr bool Fail(Error err, std::size_t pos) {
+            if (fError == kNone) {
+                fError = err;
+                fErrPos = pos;
+            }
+            fTok = kBad;
+            return false;
+        }
+
+        //
+        // The lexer: same tokens as read_units.l
+        //
+        constexpr void Advance() {
+            std::size_t len = fStr.size();
+            for (;;) {
+                while (fPos < len &&
+                       (fStr[fPos] == ' ' || fStr[fPos] == '\t'))
+                    fPos++;
+                fTokPos = fPos;
+                if (fPos == len) { fTok = kEnd; return; }
+
+                char c = fStr[fPos];
+                switch (c) {
+                case '+': case '-': case '*': case '/':
+                case '^': case '(': case ')':
+                    fPos++;
+                    fTok = c;
+                    return;
+                }
+                if (IsDigit(c)) {
+                    fNum = 0;
+                    while (fPos < len && IsDigit(fStr[fPos])) {
+                        int d = fStr[fPos++] - '0';
+                        if (fNum > (INT_MAX - d)/10) {
+                            Fail(kOverflow, fTokPos);
+                            return;
+                        }
+                        fNum = 10*fNum + d;
+                    }
+                    fTok = kNumber;
+                    return;
+                }
+                if (IsAlpha(c)) {
+                    while (fPos < len && IsAlpha(fStr[fPos])) fPos++;
+                    fSym = fStr.substr(fTokPos, fPos - fTokPos);
+                    fTok = kSymbol;
+                    return;
+                }
+                if (!fSkipIllegal) {
+                    Fail(kIllegalChar, fPos);
+                    return;
+                }
+                fPos++;
+            }
+        }
+
+        constexpr bool Expect(int tok) {
+            if (fTok != tok) return Fail(kSyntax, fTokPos);
+            Advance();
+            return true;
+        }
+
+        //
+        // symex: measure | symex '*' symex | symex '/' symex
+        //        | symex '^' numex | '(' symex ')'
+        //
+        // Every open parenthesis has a Frame on the stack, with the product
+        // of the factors so far inside it; the bottom Frame is that of the
+        // whole expression. A factor (a symbol or a closed parenthesis, with
+        // its powers) is multiplied into the top Frame, or divided, as sign
+        // says.
+        //
+        struct Frame {
+            Exp fExp {};
+            double fScale = 1.0;
+            int fSign = 1;
+        };
+
+        // A stack of Frames: kInline in place, the rest on the heap
+        class FrameStack {
+        public:
+            constexpr FrameStack(): fSize(0) {};
+            constexpr std::size_t Size() const { return fSize; }
+            constexpr Frame& Top() {
+                return (fSize <= kInline) ? fInline[fSize - 1]
+                                          : fMore[fSize - kInline - 1];
+            }
+            constexpr void Push() {
+                if (fSize < kInline) fInline[fSize] = Frame();
+                else fMore.emplace_back();
+                fSize++;
+            }
+            constexpr void Pop() {
+                if (fSize > kInline) fMore.pop_back();
+                fSize--;
+            }
+        private:
+            static constexpr std::size_t kInline = 8;
+            std::array<Frame, kInline> fInline;
+            std::vector<Frame> fMore;
+            std::size_t fSize;
+        };
+
+        constexpr bool SymExpr(Exp& exp, double& scale) {
+            FrameStack st;
+            st.Push();
+            for (;;) {
+                // A factor: the open parentheses, then a symbol
+                while (fTok == '(') {
+                    Advance();
+                    st.Push();
+                }
+                Exp cur {};
+                double cscale = 1.0;
+                if (!SymPrimary(cur, cscale)) return false;
+
+                for (;;) {
+                    // Its powers
+                    while (fTok == '^') {
+                        std::size_t pos = fTokPos;
+                        Advance();
+                        int pwr = 0;
+                        if (!NumExponent(pwr)) return false;
+                        for (int mu=0; mu<NMEAS; mu++)
+                            if (!Arith('*', cur[mu], pwr, pos)) return false;
+                        cscale = ScalePow(cscale, pwr);
+                    }
+
+                    Frame& top = st.Top();
+                    for (int mu=0; mu<NMEAS; mu++)
+                        if (!Arith((top.fSign > 0) ? '+' : '-', top.fExp[mu],
+                                   cur[mu], fTokPos))
+                            return false;
+                    top.fScale = (top.fSign > 0) ? top.fScale*cscale
+                                                 : top.fScale/cscale;
+
+                    if (fTok == '*' || fTok == '/') {
+                        top.fSign = (fTok == '*') ? 1 : -1;
+                        Advance();
+                        break;  // On to the next factor
+                    }
+                    if (st.Size() == 1) {
+                        exp = top.fExp;
+                        scale = top.fScale;
+                        return true;
+                    }
+                    // Closed parenthesis: a factor, which may have powers
+                    if (!Expect(')')) return false;
+                    cur = top.fExp;
+                    cscale = top.fScale;
+                    st.Pop();
+                }
+            }
+        }
+
+        // measure
+        constexpr bool SymPrimary(Exp& exp, double& scale) {
+            if (fTok == kSymbol) {
+                if (fLookup) {
+                    if (!fLookup(fRegistry, fSym, exp, scale))
+                        return Fail(kUnknownSymbol, fTokPos);
+                }
+                else {
+                    int mu = GetMeas(fSym);
+                    if (mu < 0) return Fail(kUnknownSymbol, fTokPos);
+                    exp = {};
+                    exp[mu] = 1;
+                    scale = 1.0;
+                }
+                Advance();
+                return true;
+            }
+            return Fail(kSyntax, fTokPos);
+        }
+
+        // Guard the recursion of the exponent expressions
+        constexpr bool Enter() {
+            if (++fDepth > kMaxDepth) return Fail(kTooDeep, fTokPos);
+            return true;
+        }
+
+        //
+        // numex, with the precedences of read_units.y:
+        // '+' '-'  <  '*' '/'  <  unary '-' '+'  <  '^' (right assoc.)
+        //
+        constexpr bool NumExpr(int& val) {
+            if (!NumTerm(val)) return false;
+            while (fTok == '+' || fTok == '-') {
+                int op = fTok, rhs = 0;
+                std::size_t pos = fTokPos;
+                Advance();
+                if (!NumTerm(rhs) || !Arith(op, val, rhs, pos)) return false;
+            }
+            return true;
+        }
+
+        //
+        // The numex after symex '^': in Bison's LALR automaton '*' and '/'
+        // end it (the rule symex '^' numex has the precedence of '^'), but
+        // '+' and '-' cannot follow a symex, so they are shifted and go on
+        // with the numex: m^2-1 is m^(2-1), while m^2*3 is an error.
+        //
+        constexpr bool NumExponent(int& val) {
+            if (!NumUnary(val)) return false;
+            while (fTok == '+' || fTok == '-') {
+                int op = fTok, rhs = 0;
+                std::size_t pos = fTokPos;
+                Advance();
+                if (!NumTerm(rhs) || !Arith(op, val, rhs, pos)) return false;
+            }
+            return true;
+        }
+
+        constexpr bool NumTerm(int& val) {
+            if (!NumUnary(val)) return false;
+            while (fTok == '*' || fTok == '/') {
+                int op = fTok, rhs = 0;
+                std::size_t pos = fTokPos;
+                Advance();
+                if (!NumUnary(rhs) || !Arith(op, val, rhs, pos)) return false;
+            }
+            return true;
+        }
+
+        constexpr bool NumUnary(int& val) {
+            if (fTok == '-' || fTok == '+') {
+                int op = fTok;
+                std::size_t pos = fTokPos;
+                Advance();
+                if (!Enter() || !NumUnary(val)) return false;
+                fDepth--;
+                if (op == '-') {
+                    int arg = val;
+                    val = 0;
+                    return Arith('-', val, arg, pos);
+                }
+                return true;
+            }
+            return NumPower(val);
+        }
+
+        constexpr bool NumPower(int& val) {
+            if (!NumAtom(val)) return false;
+            if (fTok == '^') {
+                std::size_t pos = fTokPos;
+                Advance();
+                int pwr = 0;
+                if (!Enter() || !NumUnary(pwr)) return false;
+                fDepth--;
+                if (val == 0 && pwr < 0) return Fail(kDivByZero, pos);
+                if (!IntPow(val, pwr)) return Fail(kOverflow, pos);
+            }
+            return true;
+        }
+
+        constexpr bool NumAtom(int& val) {
+            if (fTok == kNumber) {
+                val = fNum;
+                Advance();
+                return true;
+            }
+            if (fTok == '(') {
+                Advance();
+                if (!Enter() || !NumExpr(val)) return false;
+                fDepth--;
+                return Expect(')');
+            }
+            return Fail(kSyntax, fTokPos);
+        }
+
+        // val op= rhs, or the error at pos: division by zero, or a result
+        // out of the int range (INT_MIN/-1 included)
+        constexpr bool Arith(int op, int& val, int rhs, std::size_t pos) {
+            bool ovf = false;
+            switch (op) {
+            case '+': ovf = __builtin_add_overflow(val, rhs, &val); break;
+            case '-': ovf = __builtin_sub_overflow(val, rhs, &val); break;
+            case '*': ovf = __builtin_mul_overflow(val, rhs, &val); break;
+            default:
+                if (rhs == 0) return Fail(kDivByZero, pos);
+                ovf = (val == INT_MIN && rhs == -1);
+                if (!ovf) val /= rhs;
+            }
+            return ovf ? Fail(kOverflow, pos) : true;
+        }
+
+        //
+        // Same as ipow() in read_units_funcs.c: val = val^pwr by squaring,
+        // false if it overflows. A square is only taken when a higher bit
+        // of pwr is left, so it is a factor of the result, and overflows
+        // only if the result does.
+        //
+        static constexpr bool IntPow(int& val, int pwr) {
+            int base = val;
+            if (pwr < 0) {
+                if (base == 1) val = 1;
+                else if (base == -1) val = (pwr % 2) ? -1 : 1;
+                else val = 0;
+                return true;
+            }
+            val = 1;
+            for (;;) {
+                if ((pwr & 1) && __builtin_mul_overflow(val, base, &val))
+                    return false;
+                pwr >>= 1;
+                if (!pwr) return true;
+                if (__builtin_mul_overflow(base, base, &base)) return false;
+            }
+        }
+
+        // scale^pwr by squaring (std::pow is not constexpr); a negative
+        // power divides
+        static constexpr double ScalePow(double scale, int pwr) {
+            double val = 1.0;
+            for (unsigned n = (pwr < 0) ? -(unsigned) pwr : (unsigned) pwr;
+                 n; n >>= 1, scale *= scale)
+                if (n & 1) val *= scale;
+            return (pwr < 0) ? 1.0/val : val;
+        }
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitParser_HH__ */
@@ -0,0 +1,124 @@
+#include "MHO_UnitRegistry.hh"
+#include "MHO_UnitParser.hh"
+
+
+namespace hops
+{
+
+    MHO_UnitRegistry& MHO_UnitRegistry::GetInstance() {
+        static MHO_UnitRegistry registry;
+        return registry;
+    }
+
+    MHO_UnitRegistry::Table::Table(std::size_t capacity):
+        fMask(capacity - 1),
+        fSlot(new std::atomic<const Entry*>[capacity]) {
+        for (std::size_t i=0; i<capacity; i++)
+            fSlot[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    MHO_UnitRegistry::MHO_UnitRegistry(): fTable(nullptr), fSize(0) {
+        fTables.emplace_back(new Table(64));
+        fTable.store(fTables.back().get(), std::memory_order_release);
+        for (int mu=0; mu<NMEAS; mu++) {
+            std::array<int, NMEAS> exp {};
+            exp[mu] = 1;
+            Register(MHO_UnitParser::kMeasTab[mu], exp);
+        }
+    }
+
+    // FNV-1a: the symbols are short, so a byte loop is fastest
+    uint64_t MHO_UnitRegistry::Hash(std::string_view symbol) {
+        uint64_t hash = 14695981039346656037ULL;
+        for (char c : symbol) {
+            hash ^= (unsigned char) c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    const MHO_UnitRegistry::Entry*
+    MHO_UnitRegistry::Find(const Table* table, std::string_view symbol,
+                           uint64_t hash) const {
+        for (std::size_t i=hash & table->fMask; ; i=(i + 1) & table->fMask) {
+            const Entry* entry =
+                table->fSlot[i].load(std::memory_order_acquire);
+            if (!entry) return nullptr;
+            if (entry->fHash == hash && entry->fSymbol == symbol)
+                return entry;
+        }
+    }
+
+    // Writers only; the table is never full (load factor <= 1/2)
+    void MHO_UnitRegistry::Put(Table* table, const Entry* entry) {
+        std::size_t i = entry->fHash & table->fMask;
+        while (table->fSlot[i].load(std::memory_order_relaxed))
+            i = (i + 1) & table->fMask;
+        table->fSlot[i].store(entry, std::memory_order_release);
+    }
+
+    bool MHO_UnitRegistry::Lookup(std::string_view symbol,
+                                  std::array<int, NMEAS>& exp) const {
+        const Entry* entry = Find(fTable.load(std::memory_order_acquire),
+                                  symbol, Hash(symbol));
+        if (!entry) return false;
+        exp = entry->fExp;
+        return true;
+    }
+
+    bool MHO_UnitRegistry::Register(std::string_view symbol,
+                                    const std::array<int, NMEAS>& exp) {
+        if (symbol.empty()) return false;
+        for (char c : symbol)
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+                return false;
+
+        std::lock_guard<std::mutex> lock(fMutex);
+        uint64_t hash = Hash(symbol);
+        Table* table = fTables.back().get();
+        if (const Entry* old = Find(table, symbol, hash))
+            return old->fExp == exp;
+
+        // Grow: fill a table twice as big, then publish it
+        std::size_t size = fSize.load(std::memory_order_relaxed);
+        if (2*(size + 1) > table->fMask + 1) {
+            std::unique_ptr<Table> bigger(new Table(2*(table->fMask + 1)));
+            for (const Entry& entry : fEntries) Put(bigger.get(), &entry);
+            fTables.push_back(std::move(bigger));
+            table = fTables.back().get();
+            fTable.store(table, std::memory_order_release);
+        }
+
+        fEntries.push_back(Entry{std::string(symbol), hash, exp});
+        Put(table, &fEntries.back());
+        fSize.store(size + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool MHO_UnitRegistry::Register(std::string_view symbol,
+                                    std::string_view definition) {
+        MHO_UnitParser parser(definition);
+        parser.SetLookup(LookupFn, this);
+        MHO_UnitParser::Result res = parser.Parse();
+        return res.Ok() && Register(symbol, res.fExp);
+    }
+
+    bool MHO_UnitRegistry::LookupFn(const void* registry,
+                                    std::string_view sym,
+                                    std::array<int, NMEAS>& exp,
+                                    double& scale) {
+        scale = 1.0;
+        return static_cast<const MHO_UnitRegistry*>(registry)->Lookup(sym,
+                                                                      exp);
+    }
+
+    int MHO_UnitRegistry::LookupC(const void* registry, const char* sym,
+                                  meas_pow* mpow) {
+        std::array<int, NMEAS> exp;
+        if (!static_cast<const MHO_UnitRegistry*>(registry)->Lookup(sym, exp))
+            return 0;
+        for (int mu=0; mu<NMEAS; mu++) mpow->exp[mu] = exp[mu];
+        return 1;
+    }
+
+}
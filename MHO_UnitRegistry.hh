@@ -0,0 +1,98 @@
+#ifndef MHO_UnitRegistry_HH__
+#define MHO_UnitRegistry_HH__
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "read_units.h"
+
+
+namespace hops
+{
+
+    //
+    // Registry of the unit symbols known to the parsers. The NMEAS base
+    // units of MHO_UnitParser::kMeasTab are registered from the start;
+    // any number of other symbols can be registered at run time as names
+    // of exponent arrays over the base units ("N" as kg*m/s^2, say). A
+    // unit expression cannot be re-registered with another meaning.
+    //
+    // Lookup is by hash, in an open-addressing table that readers probe
+    // without any lock: the entries are immutable once published, and a
+    // table that has to grow is replaced as a whole by a bigger copy. The
+    // retired tables are kept until the registry dies, so a reader still
+    // probing one is safe. Registration takes a mutex.
+    //
+    class MHO_UnitRegistry
+    {
+    public:
+
+        static MHO_UnitRegistry& GetInstance();
+
+        MHO_UnitRegistry();
+        MHO_UnitRegistry(const MHO_UnitRegistry&) = delete;
+        MHO_UnitRegistry& operator=(const MHO_UnitRegistry&) = delete;
+
+        // Register the symbol (letters only, as the lexer reads them) as
+        // the unit with the exponents exp. Returns false if the symbol is
+        // malformed or already registered with other exponents.
+        bool Register(std::string_view symbol,
+                      const std::array<int, NMEAS>& exp);
+
+        // The same, with the unit given by an expression of the units
+        // already registered, e.g. Register("N", "kg*m/s^2")
+        bool Register(std::string_view symbol, std::string_view definition);
+
+        // Returns true and sets exp if the symbol is registered
+        bool Lookup(std::string_view symbol,
+                    std::array<int, NMEAS>& exp) const;
+
+        // The number of symbols. It only grows, one per registration, so
+        // a change tells that a string may now parse differently.
+        std::size_t GetSize() const {
+            return fSize.load(std::memory_order_acquire);
+        }
+
+        // Lookup functions for the parsers (MHO_UnitParser::LookupFn,
+        // parse_ctx.lookup); registry points at an MHO_UnitRegistry
+        static bool LookupFn(const void* registry, std::string_view sym,
+                             std::array<int, NMEAS>& exp, double& scale);
+        static int LookupC(const void* registry, const char* sym,
+                           meas_pow* mpow);
+
+    private:
+
+        struct Entry {
+            std::string fSymbol;
+            uint64_t fHash;
+            std::array<int, NMEAS> fExp;
+        };
+
+        struct Table {
+            std::size_t fMask;  // Capacity - 1, a power of two
+            std::unique_ptr<std::atomic<const Entry*>[]> fSlot;
+            explicit Table(std::size_t capacity);
+        };
+
+        static uint64_t Hash(std::string_view symbol);
+        const Entry* Find(const Table* table, std::string_view symbol,
+                          uint64_t hash) const;
+        static void Put(Table* table, const Entry* entry);
+
+        std::atomic<const Table*> fTable;
+        std::atomic<std::size_t> fSize;
+        std::mutex fMutex;  // Serializes the writers
+        std::vector<std::unique_ptr<Table> > fTables; // Current and retired
+        std::deque<Entry> fEntries;  // Stable addresses
+    };
+
+}
+
+#endif /* end of include guard: MHO_UnitRegistry_HH__ */
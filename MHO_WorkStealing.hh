@@ -0,0 +1,191 @@
+#ifndef MHO_WorkStealing_HH__
+#define MHO_WorkStealing_HH__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace hops
+{
+
+    //
+    // The worker threads of MHO_ParallelFor, kept from call to call, so
+    // that a burst of small batches does not pay for starting threads:
+    // they are started when first needed, and wait on a condition
+    // variable for the next batch. The pool runs one batch at a time; a
+    // caller that finds it busy (with a batch of another thread, or in a
+    // nested call) gets false back and runs the batch otherwise.
+    //
+    class MHO_WorkerPool
+    {
+    public:
+
+        typedef void (*Job)(void* ctx, unsigned worker);
+
+        static MHO_WorkerPool& GetInstance() {
+            static MHO_WorkerPool pool;
+            return pool;
+        }
+
+        MHO_WorkerPool() = default;
+        MHO_WorkerPool(const MHO_WorkerPool&) = delete;
+        MHO_WorkerPool& operator=(const MHO_WorkerPool&) = delete;
+
+        ~MHO_WorkerPool() {
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                fStop = true;
+            }
+            fWake.notify_all();
+            for (auto& th : fThreads) th.join();
+        }
+
+        // Run job(ctx, w) for w in [1, nworkers] on the pool threads and
+        // job(ctx, 0) on the calling thread, and return when all are
+        // done; false, with nothing run, if the pool is busy
+        bool Run(unsigned nworkers, Job job, void* ctx) {
+            std::unique_lock<std::mutex> batch(fBatch, std::try_to_lock);
+            if (!batch) return false;
+            {
+                std::lock_guard<std::mutex> lock(fMutex);
+                while (fThreads.size() < nworkers)
+                    fThreads.emplace_back(&MHO_WorkerPool::Loop, this,
+                                          (unsigned) fThreads.size() + 1);
+                fJob = job;
+                fCtx = ctx;
+                fActive = nworkers;
+                fPending = nworkers;
+                fGeneration++;
+            }
+            fWake.notify_all();
+            job(ctx, 0);
+            std::unique_lock<std::mutex> lock(fMutex);
+            fDone.wait(lock, [this] { return fPending == 0; });
+            return true;
+        }
+
+    private:
+
+        // Worker self (from 1) takes part in the batches of up to fActive
+        // workers; a batch is not replaced before all of them are done
+        void Loop(unsigned self) {
+            uint64_t seen = 0;
+            std::unique_lock<std::mutex> lock(fMutex);
+            for (;;) {
+                fWake.wait(lock, [&] {
+                    return fStop || fGeneration != seen;
+                });
+                if (fStop) return;
+                seen = fGeneration;
+                if (self > fActive) continue;
+                Job job = fJob;
+                void* ctx = fCtx;
+                lock.unlock();
+                job(ctx, self);
+                lock.lock();
+                if (--fPending == 0) fDone.notify_one();
+            }
+        }
+
+        std::mutex fBatch;  // Held through a batch
+        std::mutex fMutex;  // Guards the rest
+        std::condition_variable fWake, fDone;
+        std::vector<std::thread> fThreads;
+        uint64_t fGeneration = 0;
+        unsigned fActive = 0, fPending = 0;
+        Job fJob = nullptr;
+        void* fCtx = nullptr;
+        bool fStop = false;
+    };
+
+    //
+    // Run func(begin, end) over [0, n) in chunks of chunk items, with
+    // nthreads workers (0: one per core); the calling thread is one of
+    // them. The chunks are dealt out as one contiguous range per worker.
+    // A worker takes the chunks from the low end of its own range; when
+    // the range is empty it steals the upper half of another worker's
+    // range, so uneven work is balanced without any lock. The workers
+    // are those of the MHO_WorkerPool, or, if it is busy, threads
+    // started for the call.
+    //
+    template <typename F>
+    void MHO_ParallelFor(std::size_t n, std::size_t chunk, unsigned nthreads,
+                         F func)
+    {
+        if (chunk == 0) chunk = 1;
+        std::size_t nchunk = (n + chunk - 1)/chunk;
+        if (nthreads == 0) nthreads = std::thread::hardware_concurrency();
+        if (nthreads == 0) nthreads = 1;
+        if (nthreads > nchunk) nthreads = (unsigned) nchunk;
+        if (nthreads <= 1) {
+            if (n) func((std::size_t) 0, n);
+            return;
+        }
+
+        // A range of chunk indices [lo, hi), packed in one word
+        struct alignas(64) Range { std::atomic<uint64_t> fLoHi; };
+        auto pack = [](uint64_t lo, uint64_t hi) { return lo << 32 | hi; };
+
+        std::vector<Range> ranges(nthreads);
+        for (unsigned w=0; w<nthreads; w++)
+            ranges[w].fLoHi.store(pack(nchunk*w/nthreads,
+                                       nchunk*(w + 1)/nthreads));
+
+        auto worker = [&](unsigned self) {
+            for (;;) {
+                // Own range, from below
+                std::atomic<uint64_t>& own = ranges[self].fLoHi;
+                uint64_t cur = own.load();
+                while ((cur >> 32) < (cur & 0xffffffff)) {
+                    uint64_t lo = cur >> 32;
+                    // On failure (a theft) cur is reloaded and we retry
+                    if (own.compare_exchange_weak(cur, pack(lo + 1,
+                                                  cur & 0xffffffff))) {
+                        std::size_t begin = lo*chunk;
+                        func(begin, std::min(begin + chunk, n));
+                        cur = own.load();
+                    }
+                }
+
+                // Steal the upper half of the first non-empty victim
+                bool stolen = false;
+                for (unsigned k=1; k<nthreads && !stolen; k++) {
+                    std::atomic<uint64_t>& vic =
+                        ranges[(self + k) % nthreads].fLoHi;
+                    uint64_t vcur = vic.load();
+                    for (;;) {
+                        uint64_t vlo = vcur >> 32, vhi = vcur & 0xffffffff;
+                        if (vlo >= vhi) break;
+                        uint64_t mid = vlo + (vhi - vlo)/2;
+                        if (vic.compare_exchange_weak(vcur, pack(vlo, mid))) {
+                            own.store(pack(mid, vhi));
+                            stolen = true;
+                            break;
+                        }
+                    }
+                }
+                if (!stolen) return;  // Nothing left anywhere
+            }
+        };
+
+        auto job = [](void* ctx, unsigned self) {
+            (*static_cast<decltype(worker)*>(ctx))(self);
+        };
+        if (MHO_WorkerPool::GetInstance().Run(nthreads - 1, job, &worker))
+            return;
+
+        std::vector<std::thread> pool;
+        for (unsigned w=1; w<nthreads; w++) pool.emplace_back(worker, w);
+        worker(0);
+        for (auto& th : pool) th.join();
+    }
+
+}
+
+#endif /* end of include guard: MHO_WorkStealing_HH__ */
@@ -0,0 +1,1731 @@
+/*
+ * Benchmarks for the MHO_Unit class
+ *
+ * Thread scaling of the string parsing: every thread constructs MHO_Unit
+ * objects from the same corpus of unit expressions, checking the results
+ * against those obtained in a single thread beforehand.
+ *
+ * The same, with the MHO_UnitCache of parsed strings enabled.
+ *
+ * Unit algebra (*, /, ==) on the int array exponents of MHO_Unit against
+ * the packed int8 lanes of MHO_PackedUnit, and the overflow of a power.
+ *
+ * Copying, sorting and memcpy-ing a million units, which are trivially
+ * copyable: the copy should run at memory bandwidth.
+ *
+ * Formatting a million units into one preallocated text buffer with
+ * ToChars() (and std::format_to, where the library has it) against
+ * appending their GetUnitString(), and ToChars() into buffers from
+ * empty to an exact fit.
+ *
+ * Heap allocations and time per parse with the AST and list nodes taken
+ * from the heap or from a reused arena, and in the direct mode, without
+ * the nodes.
+ *
+ * The Flex/Bison and the hand-written parser engines: check that they
+ * agree on a large random corpus, valid and invalid, and time them.
+ *
+ * Thread scaling of the batch parsing, MHO_Unit::ParseMany, and the time
+ * per batch of bursts of small batches, from one thread and from several
+ * at once.
+ *
+ * Symbol lookup in the MHO_UnitRegistry with hundreds of units registered,
+ * against a linear search of a table of the same symbols.
+ *
+ * Scaling with the expression size, up to hundreds of kilobytes: long
+ * products, deep parentheses and deeply nested powers, parsed by the
+ * three parsers (Flex/Bison in the direct and the AST mode, and the
+ * hand-written one) on a thread with a small stack. The time per byte
+ * must stay flat.
+ *
+ * Parsing unit fields in place out of a read-only memory-mapped file,
+ * through std::string_view, against making a std::string of each field.
+ *
+ * Validation of dirty unit strings: MHO_Unit::TryParse against
+ * constructing MHO_Unit objects (with the errors printed to /dev/null).
+ * TryParse must allocate nothing on failure (the strings nest at most 8
+ * parentheses deep), and agree with Flex/Bison on the strings it accepts;
+ * exponents and unit powers out of the int range must be errors with
+ * both engines.
+ *
+ * Loading a million units from a read-only mapped file of MHO_UnitBinary
+ * records, against parsing them from their strings, with the round trip
+ * through the records and the text checked.
+ *
+ * Lookups in maps keyed by MHO_Unit (hashed, ordered, and a sorted
+ * array as a flat map) against a hash map keyed by GetUnitString().
+ *
+ * Interning units from several threads at once: the threads must get
+ * the same IDs, and the IDs their units and strings back. Lookup by unit
+ * and by ID, and equality of IDs against equality of units.
+ *
+ * The memoized algebra of the IDs (Multiply, Divide, Power) from several
+ * threads, checked against the algebra of the units, and timed against
+ * it on a few hundred distinct units.
+ *
+ * Elementwise algebra on a million units: a std::vector of MHO_Unit and
+ * of MHO_PackedUnit against the columns of an MHO_UnitArray, checked for
+ * the same results, with the overflow and size checks of the array. The
+ * compatibility in the base dimensions (Hz as s^-1, Jy as kg*s^-2) of
+ * each unit, through MHO_UnitDimension, against CompatibleMask().
+ *
+ * Chains of unit algebra through the expression templates, checked
+ * against the same steps on MHO_Unit temporaries.
+ *
+ * Unit conversion of large arrays (MHz to Hz, deg to rad, mJy to Jy):
+ * the SIMD kernel against a scalar loop, checked for the same results.
+ *
+ * The regression suite: parsing of short, long and deeply nested
+ * expressions with both engines, GetUnitString, ToChars, the unit by
+ * unit and unit by string operators, the chain (u1*u2)/(u3^2)*u4 fused
+ * (from MHO_UnitRef), of units and in steps, and equality. Each case gives
+ * ns/op, allocations/op and the peak RSS so far, and with
+ *
+ *     ./bench_units [niter] [file]
+ *
+ * they are also written to file ("-": stdout) as CSV lines
+ *
+ *     case,ns_per_op,allocs_per_op,peak_rss_kb
+ *
+ * for tracking regressions between releases.
+ */
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <chrono>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "MHO_Unit.hh"
+#include "MHO_BasicUnit.hh"
+#include "MHO_UnitArray.hh"
+#include "MHO_UnitBinary.hh"
+#include "MHO_UnitCache.hh"
+#include "MHO_UnitConversion.hh"
+#include "MHO_UnitDimension.hh"
+#include "MHO_UnitIntern.hh"
+#include "MHO_UnitFormat.hh"
+#include "MHO_UnitRegistry.hh"
+#include "read_units.tab.h"
+#include "read_units.lex.h"
+
+using namespace hops;
+
+//
+// Count the heap allocations: malloc() and friends are interposed over
+// those of glibc, so both the C parser and operator new are seen.
+//
+extern "C" {
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t nmemb, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+}
+
+static std::atomic<long> nalloc(0);
+
+extern "C" void *malloc(size_t size) {
+    nalloc.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size) {
+    nalloc.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    nalloc.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+static volatile long sink;  // Keeps the results of the ops alive
+
+static const std::vector<std::string> corpus = {
+    "m", "kg", "s", "Jy", "Hz", "rad", "deg", "sr",
+    "m/s^2", "kg*m/s^2", "kg*m^2/s^2", "rad/s", "Jy*sr", "mol/s",
+    " A*kg*(m^-1*s^-2)^3",
+    " A * kg *(m^-1*s^-2)^3  ",
+    "kg^-1 * (m^-1 * s^-2)^(-3) / m^2",
+    "m * ((kg^2*s^-3/A)^-5 * K^5/cd/(mol*Hz)^3*s)^2 * rad * Jy^(7 + 2*(4 - 6))"
+};
+
+//
+// Parse the corpus niter times in each of nthreads threads.
+// Returns the wall time in seconds; counts wrong results in nbad.
+//
+static double parse_threads(int nthreads, int niter,
+                            const std::vector<std::array<int, NMEAS>>& ref,
+                            int& nbad) {
+    std::vector<std::thread> pool;
+    std::vector<int> bad(nthreads, 0);
+    auto t0 = std::chrono::steady_clock::now();
+    for (int t=0; t<nthreads; t++)
+        pool.emplace_back([&, t]() {
+            for (int it=0; it<niter; it++)
+                for (size_t i=0; i<corpus.size(); i++) {
+                    MHO_Unit u(corpus[i]);
+                    if (u.GetUnitExp() != ref[i]) bad[t]++;
+                }
+        });
+    for (auto& th : pool) th.join();
+    auto t1 = std::chrono::steady_clock::now();
+    nbad = 0;
+    for (int b : bad) nbad += b;
+    return std::chrono::duration<double>(t1 - t0).count();
+}
+
+
+//
+// Time a*b/c == d over the array of units, niter times.
+// Returns ns per operation (three per element); check defeats the optimizer.
+//
+template <typename U>
+static double algebra_ns(const std::vector<U>& units, int niter,
+                         long& check) {
+    size_t n = units.size();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int it=0; it<niter; it++)
+        for (size_t i=0; i<n; i++) {
+            U p = units[i] * units[(i+1)%n];
+            U q = p / units[(i+3)%n];
+            check += (q == units[(i+it)%n]);
+        }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / (3.0*niter*n);
+}
+
+
+//
+// Parse the corpus niter times with the C parser, the nodes taken from
+// the arena ar, or from the heap if ar is NULL; no nodes if direct.
+// Returns ns per parse; sets allocs to the heap allocations per parse.
+//
+static double parse_nodes_ns(unit_arena *ar, int direct, int niter,
+                             double& allocs) {
+    yyscan_t scanner;
+    meas_pow mpow;
+    yylex_init(&scanner);
+    long n0 = nalloc.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int it=0; it<niter; it++)
+        for (const auto& str : corpus) {
+            parse_ctx ctx = {};
+            ctx.arena = ar;
+            ctx.direct = direct;
+            YY_BUFFER_STATE buf = yy_scan_string(str.c_str(), scanner);
+            if (yyparse(scanner, &ctx) == 0 && !direct)
+                explst_to_arr_and_free(ar, ctx.explst, &mpow);
+            yy_delete_buffer(buf, scanner);
+            if (ar) arena_reset(ar);
+        }
+    auto t1 = std::chrono::steady_clock::now();
+    double nparse = (double) niter*corpus.size();
+    allocs = (nalloc.load() - n0) / nparse;
+    yylex_destroy(scanner);
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / nparse;
+}
+
+
+//
+// Random unit expressions from the grammar of read_units.y, with random
+// blanks; with probability pbad spoiled by deleting or inserting a char.
+// The numbers are small, and a symex raised to a power is parenthesized
+// if it may end with a power itself, so that no exponent overflows.
+//
+static std::string gen_numex(std::mt19937& rng, int depth) {
+    std::string num = std::to_string(rng() % 4);
+    switch (depth > 0 ? rng() % 6 : 0) {
+    case 1: return "-" + gen_numex(rng, depth-1);
+    case 2: return gen_numex(rng, depth-1) + "+" + gen_numex(rng, depth-1);
+    case 3: return gen_numex(rng, depth-1) + " - " + num;
+    case 4: return "(" + gen_numex(rng, depth-1) + ")";
+    case 5: return num + "^" + std::to_string(rng() % 3);
+    default: return num;
+    }
+}
+
+static std::string gen_symex(std::mt19937& rng, int depth);
+
+static std::string gen_base(std::mt19937& rng, int depth) {
+    std::string base = gen_symex(rng, depth);
+    char last = base.back();
+    if (last == ')' || (last >= '0' && last <= '9'))
+        base = "(" + base + ")";
+    return base;
+}
+
+static std::string gen_symex(std::mt19937& rng, int depth) {
+    static const char *const syms[] = {"m", "kg", "s", "A", "K", "cd", "mol",
+                                       "Hz", "rad", "deg", "sr", "Jy", "xyz"};
+    std::string sp = (rng() % 4) ? "" : " ";
+    switch (depth > 0 ? rng() % 7 : 0) {
+    case 1: case 2:
+        return gen_symex(rng, depth-1) + sp + "*" + sp
+            + gen_symex(rng, depth-1);
+    case 3:
+        return gen_symex(rng, depth-1) + sp + "/" + sp
+            + gen_symex(rng, depth-1);
+    case 4:
+        return gen_base(rng, depth-1) + "^" + std::to_string(rng() % 4);
+    case 5:
+        return gen_base(rng, depth-1) + "^(" + gen_numex(rng, 2) + ")";
+    case 6:
+        return "(" + sp + gen_symex(rng, depth-1) + sp + ")";
+    default:
+        return syms[rng() % (rng() % 20 ? 12 : 13)];
+    }
+}
+
+static std::vector<std::string> gen_corpus(int n, double pbad,
+                                           unsigned seed) {
+    static const char edits[] = "()*^+-m ";
+    std::mt19937 rng(seed);
+    std::vector<std::string> cps;
+    for (int i=0; i<n; i++) {
+        std::string str = gen_symex(rng, 4);
+        if (rng() % 1000 < pbad*1000) {
+            size_t pos = rng() % str.size();
+            if (rng() % 2)
+                str.erase(pos, 1);
+            else
+                str.insert(pos, 1, edits[rng() % (sizeof(edits) - 1)]);
+        }
+        cps.push_back(str);
+    }
+    return cps;
+}
+
+//
+// Parse every string with both engines, the parse errors to /dev/null.
+// Returns the number of strings where the engines disagree.
+//
+static int engines_differ(const std::vector<std::string>& cps, int& nvalid) {
+    const std::array<int, NMEAS> none = {99, 99};
+    int ndiff = 0;
+    nvalid = 0;
+    fflush(stderr);
+    int fd2 = dup(2), fdnull = open("/dev/null", O_WRONLY);
+    dup2(fdnull, 2);
+    for (const auto& str : cps) {
+        MHO_Unit fb(none), hw(none);
+        MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+        fb.SetUnitString(str);
+        MHO_Unit::SetEngine(MHO_Unit::kHandWritten);
+        hw.SetUnitString(str);
+        if (fb != hw) ndiff++;
+        if (fb.GetUnitExp() != none) nvalid++;
+    }
+    MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+    fflush(stderr);
+    dup2(fd2, 2);
+    close(fd2);
+    close(fdnull);
+    return ndiff;
+}
+
+// Single thread parse of the corpus with an engine, ns per parse
+static double engine_ns(MHO_Unit::Engine engine, int niter) {
+    MHO_Unit::SetEngine(engine);
+    long check = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int it=0; it<niter; it++)
+        for (const auto& str : corpus) check += MHO_Unit(str).GetUnitExp()[0];
+    auto t1 = std::chrono::steady_clock::now();
+    MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / ((double) niter*corpus.size()) + 0*check;
+}
+
+// Register nsym derived units with random names; returns the names
+static std::vector<std::string> gen_registry(int nsym, unsigned seed) {
+    std::mt19937 rng(seed);
+    MHO_UnitRegistry& reg = MHO_UnitRegistry::GetInstance();
+    std::vector<std::string> syms;
+    while ((int) syms.size() < nsym) {
+        std::string sym = "x";
+        int len = 2 + rng() % 8;
+        for (int i=0; i<len; i++) sym += (char) ((rng() % 2 ? 'a' : 'A')
+                                                 + rng() % 26);
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = (int) (rng() % 5) - 2;
+        if (reg.Register(sym, exp)) syms.push_back(sym);
+    }
+    return syms;
+}
+
+// ns per lookup of the symbols, in the registry or by linear search
+static double lookup_ns(const std::vector<std::string>& syms, bool linear,
+                        int niter, long& check) {
+    const MHO_UnitRegistry& reg = MHO_UnitRegistry::GetInstance();
+    std::array<int, NMEAS> exp;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int it=0; it<niter; it++)
+        for (size_t i=0; i<syms.size(); i++) {
+            std::string_view sym = syms[(i*7919) % syms.size()];
+            if (linear) {
+                size_t k = 0;
+                while (k < syms.size() && syms[k] != sym) k++;
+                check += k;
+            }
+            else if (reg.Lookup(sym, exp))
+                check += exp[0];
+        }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / ((double) niter*syms.size());
+}
+
+// The plain loop, kept from being vectorized by the compiler
+template <typename T>
+__attribute__((optimize("no-tree-vectorize")))
+static void scale_loop(T *v, size_t n, T f) {
+    for (size_t i=0; i<n; i++) v[i] *= f;
+}
+
+//
+// ns per unit to copy the vector of units (0), to sort the copy (1), and
+// to memcpy it to bytes and back (2); the results are checked against
+// the originals, and nwrong counts the mismatches
+//
+static double copy_ns(const std::vector<MHO_Unit>& units, int how,
+                      int& nwrong) {
+    std::vector<MHO_Unit> copy(units.size());
+    std::vector<char> bytes(units.size()*sizeof(MHO_Unit));
+    auto t0 = std::chrono::steady_clock::now();
+    if (how == 0) copy = units;
+    else if (how == 1) {
+        copy = units;
+        std::sort(copy.begin(), copy.end());
+    }
+    else {
+        memcpy(bytes.data(), units.data(), bytes.size());
+        memcpy(copy.data(), bytes.data(), bytes.size());
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    if (how == 1) {
+        nwrong += !std::is_sorted(copy.begin(), copy.end());
+        std::vector<MHO_Unit> ref = units;
+        std::stable_sort(ref.begin(), ref.end());
+        nwrong += (copy != ref);
+    }
+    else
+        nwrong += (copy != units);
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / units.size();
+}
+
+//
+// ns and allocations per unit, writing the units one per line into a
+// text buffer: 0 by GetUnitString() of fresh units, 1 by ToChars(),
+// 2 by std::format_to
+//
+static double table_ns(const std::vector<MHO_Unit>& units, int how,
+                       std::string& text, double& allocs) {
+    text.clear();
+    std::vector<char> buf(units.size()*(MHO_Unit::kMaxChars + 1));
+    char *p = buf.data(), *end = p + buf.size();
+    long n0 = nalloc.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& u : units) {
+        if (how == 0) {
+            MHO_Unit fresh(u.GetUnitExp());
+            const std::string& str = fresh.GetUnitString();
+            p = std::copy(str.begin(), str.end(), p);
+        }
+        else if (how == 1)
+            p = u.ToChars(p, end).ptr;
+#if defined(__cpp_lib_format)
+        else
+            p = std::format_to(p, "{}", u);
+#endif
+        *p++ = '\n';
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    allocs = (nalloc.load() - n0) / (double) units.size();
+    text.assign(buf.data(), p);
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / units.size();
+}
+
+// ns per value of the conversion of vals, by the kernel or a scalar loop
+template <typename T>
+static double convert_ns(std::vector<T>& vals, const char *from,
+                         const char *to, bool simd, int niter) {
+    MHO_UnitConversion conv(from, to);
+    T f = (T) conv.GetFactor();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int it=0; it<niter; it++) {
+        if (simd)
+            conv.Apply(std::span<T>(vals));
+        else {
+            scale_loop(vals.data(), vals.size(), f);
+        }
+        std::swap(from, to);  // Back and forth, to keep the values sane
+        conv = MHO_UnitConversion(from, to);
+        f = (T) conv.GetFactor();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / ((double) niter*vals.size());
+}
+
+// The kernel gives the scalar results, at all lengths of the tail
+template <typename T>
+static int convert_differ() {
+    int ndiff = 0;
+    for (size_t n=0; n<70; n++) {
+        std::vector<T> v(n), w(n);
+        for (size_t i=0; i<n; i++) v[i] = w[i] = (T) (i + 0.5);
+        MHO_UnitConversion::Scale(std::span<T>(v), (T) 1e-3);
+        for (size_t i=0; i<n; i++) ndiff += (v[i] != w[i]*(T) 1e-3);
+    }
+    return ndiff;
+}
+
+
+//
+// Expressions of about size bytes: shape 0 is a product m*kg/s*m*kg/s...,
+// 1 is m*kg in parentheses nested deep, 2 is m raised to -1 in nested
+// parentheses, ((m)^-1)^-1... The exponents they reduce to are put in exp.
+//
+static std::string scaling_expr(int shape, size_t size,
+                                std::array<int, NMEAS>& exp) {
+    std::string str;
+    exp = {};
+    if (shape == 0) {
+        str = "m";
+        exp[0] = 1;
+        for (int k=1; str.size() < size; k++) {
+            str += (k % 3 == 0) ? "*m" : (k % 3 == 1) ? "*kg" : "/s";
+            exp[(k % 3 == 0) ? 0 : (k % 3 == 1) ? 1 : 2] += (k % 3 == 2) ? -1
+                                                                        : 1;
+        }
+    }
+    else if (shape == 1) {
+        size_t depth = (size - 4)/2;
+        str = std::string(depth, '(') + "m*kg" + std::string(depth, ')');
+        exp[0] = exp[1] = 1;
+    }
+    else {
+        size_t depth = (size - 1)/5;
+        str = std::string(depth, '(') + "m";
+        for (size_t i=0; i<depth; i++) str += ")^-1";
+        exp[0] = (depth % 2) ? -1 : 1;
+    }
+    return str;
+}
+
+// Parse str by engine 0: Flex/Bison direct, 1: Flex/Bison AST, 2: hand-written
+static bool scaling_parse(int engine, const std::string& str,
+                          std::array<int, NMEAS>& exp, unit_arena *ar) {
+    if (engine == 2) {
+        MHO_UnitParser::Result res = MHO_UnitParser(str).Parse();
+        exp = res.fExp;
+        return res.Ok();
+    }
+    yyscan_t scanner;
+    yylex_init(&scanner);
+    parse_ctx ctx = {};
+    ctx.arena = ar;
+    ctx.direct = (engine == 0);
+    YY_BUFFER_STATE buf = yy_scan_string(str.c_str(), scanner);
+    bool ok = (yyparse(scanner, &ctx) == 0);
+    if (ok) {
+        meas_pow mpow = ctx.mpow;
+        if (engine == 1) explst_to_arr_and_free(ar, ctx.explst, &mpow);
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = mpow.exp[mu];
+    }
+    yy_delete_buffer(buf, scanner);
+    yylex_destroy(scanner);
+    arena_reset(ar);
+    return ok;
+}
+
+struct ScalingRun {
+    int fFail;     // wrong parses and non-linear growths
+};
+
+// The scaling test proper, run on a thread with a small stack
+static void *scaling_run(void *arg) {
+    ScalingRun *run = (ScalingRun *) arg;
+    const char *shape_name[3] = {"product", "parens", "powers"};
+    const char *engine_name[3] = {"FlexBison", "FlexBisonAST", "HandWritten"};
+    unit_arena arena;
+    arena_init(&arena);
+    printf("# scaling with the expression size, on a 256 kB stack, "
+           "ns/byte\n");
+    printf("%8s %12s %8s %8s %8s %8s %8s %8s\n", "shape", "engine", "1k",
+           "4k", "16k", "64k", "256k", "ratio");
+    for (int shape=0; shape<3; shape++)
+        for (int engine=0; engine<3; engine++) {
+            double first = 0, worst = 0;
+            printf("%8s %12s", shape_name[shape], engine_name[engine]);
+            for (size_t size=1024; size<=256*1024; size*=4) {
+                std::array<int, NMEAS> want, got;
+                std::string str = scaling_expr(shape, size, want);
+                int nrep = (int) (256*1024/size);
+                bool ok = true;
+                auto t0 = std::chrono::steady_clock::now();
+                for (int r=0; r<nrep; r++)
+                    ok &= scaling_parse(engine, str, got, &arena) &&
+                          got == want;
+                auto t1 = std::chrono::steady_clock::now();
+                double ns = std::chrono::duration<double, std::nano>(t1 - t0)
+                    .count() / ((double) nrep*str.size());
+                printf(" %8.2f", ns);
+                if (size == 1024) first = ns;
+                worst = std::max(worst, ns/first);
+                if (!ok) run->fFail++;
+            }
+            printf(" %8.2f\n", worst);
+            // Flat up to the noise and the caches
+            if (worst > 4) {
+                printf("  %s %s: time per byte grows %.1f times\n",
+                       shape_name[shape], engine_name[engine], worst);
+                run->fFail++;
+            }
+        }
+    arena_free(&arena);
+    return NULL;
+}
+
+static int scaling_test() {
+    ScalingRun run = {0};
+    pthread_attr_t attr;
+    pthread_t th;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256*1024);
+    if (pthread_create(&th, &attr, scaling_run, &run)) {
+        printf("  scaling test: cannot start the thread\n");
+        return 1;
+    }
+    pthread_join(th, NULL);
+    pthread_attr_destroy(&attr);
+    if (run.fFail) printf("  scaling test: %d failures\n", run.fFail);
+    return run.fFail;
+}
+
+//
+// ns and allocations per field, parsing the comma-separated unit fields
+// of text by engine, from views (or std::strings made of them)
+//
+static double fields_ns(std::string_view text, MHO_Unit::Engine engine,
+                        bool views, double& allocs, long& check) {
+    MHO_Unit::SetEngine(engine);
+    long nfield = 0;
+    long n0 = nalloc.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t pos=0; pos<text.size(); ) {
+        size_t end = text.find(',', pos);
+        if (end == std::string_view::npos) end = text.size();
+        std::string_view field = text.substr(pos, end - pos);
+        if (views)
+            check += MHO_Unit(field).GetUnitExp()[2];
+        else
+            check += MHO_Unit(std::string(field)).GetUnitExp()[2];
+        nfield++;
+        pos = end + 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+    allocs = (nalloc.load() - n0) / (double) nfield;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / nfield;
+}
+
+// The fields test, on a temporary file mapped read-only
+static int fields_test() {
+    std::string text;
+    for (int i=0; i<100000; i++) {
+        if (i) text += ',';
+        text += corpus[i % corpus.size()];
+    }
+    char path[] = "/tmp/bench_unitsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, text.data(), text.size()) != (ssize_t) text.size())
+        return 1;
+    void *map = mmap(NULL, text.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    unlink(path);
+    if (map == MAP_FAILED) return 1;
+    std::string_view mapped((const char *) map, text.size());
+
+    int nfail = 0;
+    printf("# unit fields of a read-only mapped file, %zu bytes\n",
+           text.size());
+    printf("%12s %10s %14s %10s\n", "engine", "fields", "allocs/field",
+           "ns/field");
+    const char *ename[2] = {"FlexBison", "HandWritten"};
+    for (int eng=0; eng<2; eng++) {
+        long check[2] = {0, 0};
+        for (int views=0; views<2; views++) {
+            double allocs;
+            double ns = fields_ns(mapped, (MHO_Unit::Engine) eng, views,
+                                  allocs, check[views]);
+            printf("%12s %10s %14.2f %10.1f\n", ename[eng],
+                   views ? "views" : "strings", allocs, ns);
+        }
+        if (check[0] != check[1]) {
+            printf("  %s: the views parse differently\n", ename[eng]);
+            nfail++;
+        }
+    }
+    munmap(map, text.size());
+    return nfail;
+}
+
+//
+// Binary records: the valid strings of cps whose exponents fit the
+// records, repeated up to a million units, are written as records to a
+// temporary file, which is mapped read-only and decoded. Returns the
+// number of failed checks.
+//
+static int binary_test(const std::vector<std::string>& cps) {
+    const size_t n = 1 << 20;
+    const size_t rsize = MHO_UnitBinary::kRecordSize;
+    std::vector<std::string> text;
+    char rec[MHO_UnitBinary::kRecordSize];
+    size_t nwide = 0;
+    for (const auto& str : cps) {
+        auto res = MHO_Unit::TryParse(str);
+        if (!res) continue;
+        if (MHO_UnitBinary::Encode(*res, rec) == MHO_UnitBinary::kNone)
+            text.push_back(str);
+        else
+            nwide++;
+    }
+    std::vector<MHO_Unit> units(n), loaded(n);
+    for (size_t i=0; i<n; i++) units[i] = MHO_Unit(text[i % text.size()]);
+
+    int nfail = 0;
+    std::vector<char> out(n*rsize);
+    auto count = MHO_UnitBinary::EncodeMany(units, out);
+    if (count.fDone != n || count.fBad) nfail++;
+    char path[] = "/tmp/bench_unitsXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, out.data(), out.size()) != (ssize_t) out.size())
+        return 1;
+    void *map = mmap(NULL, out.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    unlink(path);
+    if (map == MAP_FAILED) return 1;
+    std::span<const char> mapped((const char *) map, out.size());
+
+    auto t0 = std::chrono::steady_clock::now();
+    count = MHO_UnitBinary::DecodeMany(mapped, loaded);
+    auto t1 = std::chrono::steady_clock::now();
+    MHO_Unit::SetEngine(MHO_Unit::kHandWritten);
+    long check = 0;
+    for (size_t i=0; i<n; i++)
+        check += MHO_Unit(text[i % text.size()]).GetUnitExp()[0];
+    auto t2 = std::chrono::steady_clock::now();
+    MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+    sink = check;
+
+    // Records to units to text, and back through the parser; the text of
+    // a dimensionless unit is empty, which the parser rejects
+    if (count.fDone != n || count.fBad || loaded != units) nfail++;
+    for (size_t i=0; i<text.size() && i<n; i++) {
+        std::string str = loaded[i].GetUnitString();
+        nfail += str.empty() ? (units[i] != MHO_Unit())
+                             : (MHO_Unit(str) != units[i]);
+    }
+    munmap(map, out.size());
+
+    // Errors: exponents out of range, other versions and layouts
+    MHO_Unit bad;
+    nfail += (MHO_UnitBinary::Encode(MHO_Unit("m^200"), rec) !=
+              MHO_UnitBinary::kOutOfRange);
+    nfail += (MHO_UnitBinary::Decode(rec, bad) !=
+              MHO_UnitBinary::kBadVersion);
+    MHO_UnitBinary::Encode(MHO_Unit("m^-128/s^127"), rec);
+    nfail += (MHO_UnitBinary::Decode(rec, bad) != MHO_UnitBinary::kNone ||
+              bad != MHO_Unit("m^-128/s^127"));
+    rec[1] = NMEAS + 1;
+    nfail += (MHO_UnitBinary::Decode(rec, bad) != MHO_UnitBinary::kBadLayout
+              || bad != MHO_Unit());
+    std::vector<MHO_UnitBinary::Error> errs(n);
+    out[5*rsize] = 2;
+    out[7*rsize + 3] = 1;
+    count = MHO_UnitBinary::DecodeMany(out, loaded, errs);
+    nfail += (count.fDone != n || count.fBad != 2 ||
+              errs[5] != MHO_UnitBinary::kBadVersion ||
+              errs[7] != MHO_UnitBinary::kBadLayout || errs[6] != 0);
+
+    // Short buffers: only the whole records are done, and counted
+    count = MHO_UnitBinary::EncodeMany(units, std::span<char>(out).first(
+                                           3*rsize + 5));
+    nfail += (count.fDone != 3 || count.fBad != 0);
+    count = MHO_UnitBinary::DecodeMany(std::span<const char>(out).first(
+                                           8*rsize - 1), loaded, errs);
+    nfail += (count.fDone != 7 || count.fBad != 1);
+
+    printf("# %zu binary records of %zu bytes from a mapped file: "
+           "%.2f ns/unit (parsing the strings: %.1f ns/unit), %d wrong\n"
+           "  (%zu valid strings have exponents out of the records' range)\n",
+           n, rsize,
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / n,
+           std::chrono::duration<double, std::nano>(t2 - t1).count() / n,
+           nfail, nwide);
+    return nfail;
+}
+
+// Powers are taken by squaring: by repeated multiplication, these would
+// run past the compiler's limit on constexpr loops
+static_assert(MHO_UnitParser("m^(1^2000000000)/s^((-1)^2147483647)")
+                  .Parse().fExp == MHO_Unit(std::array<int, NMEAS>{1, 0, 1})
+                                       .GetUnitExp(),
+              "huge powers of 1 and -1");
+
+static int validate_test(const std::vector<std::string>& cps) {
+    int nfail = 0;
+    long nbad = 0, fail_allocs = 0;
+    int fdnull = open("/dev/null", O_WRONLY);
+    int fdout = dup(1), fderr = dup(2);
+
+    // Construction, as in a validation loop before TryParse
+    fflush(stdout);
+    dup2(fdnull, 1);
+    dup2(fdnull, 2);
+    std::vector<std::array<int, NMEAS>> ref;
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& str : cps) ref.push_back(MHO_Unit(str).GetUnitExp());
+    auto t1 = std::chrono::steady_clock::now();
+    fflush(stdout);
+    dup2(fdout, 1);
+    dup2(fderr, 2);
+    close(fdnull);
+    close(fdout);
+    close(fderr);
+
+    long n0 = nalloc.load();
+    auto t2 = std::chrono::steady_clock::now();
+    for (size_t i=0; i<cps.size(); i++) {
+        long n1 = nalloc.load();
+        auto res = MHO_Unit::TryParse(cps[i]);
+        if (!res) {
+            nbad++;
+            fail_allocs += nalloc.load() - n1;
+        }
+        else if (res->GetUnitExp() != ref[i])
+            nfail++;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    // Exponents out of the int range are errors, in the numbers and in
+    // the powers of the units: kOverflow from TryParse, "exponent
+    // overflow" and a dimensionless unit from Flex/Bison
+    const char *overflow[] = {"m^(2^31/-1)", "m^(46341*46341)",
+                              "m^(2^30+2^30)", "m^(-2^31-1)", "m^(7^12)",
+                              "m^2147483648", "m^(1-2147483648-2)",
+                              "(m^65536)^65536", "m^2000000000*m^2000000000",
+                              "m^-2147483647/m^2", "s*(m^-1)^-2147483647*m",
+                              "(kg/(m^46341))^46341"};
+    int noverflow = 0;
+    FILE *msg = tmpfile();
+    fflush(stderr);
+    fderr = dup(2);
+    dup2(fileno(msg), 2);
+    for (const char *str : overflow) {
+        auto res = MHO_Unit::TryParse(str);
+        if (res || res.error().fCode != MHO_UnitParser::kOverflow)
+            noverflow++;
+        noverflow += (MHO_Unit(str) != MHO_Unit());
+    }
+    fflush(stderr);
+    dup2(fderr, 2);
+    close(fderr);
+    char line[256];
+    int nmsg = 0;
+    rewind(msg);
+    while (fgets(line, sizeof(line), msg))
+        nmsg += (strcmp(line, "Error: exponent overflow\n") == 0);
+    fclose(msg);
+    noverflow += (nmsg != (int) std::size(overflow));
+    // The ends of the range are not errors
+    auto res1 = MHO_Unit::TryParse("m^(1^2000000000)/s^((-1)^2147483647)");
+    if (!res1 || *res1 != MHO_Unit("m*s") ||
+        MHO_Unit::TryParse("m^(7^11)")->GetUnitExp()[0] != 1977326743 ||
+        MHO_Unit::TryParse("m^((-2)^31)")->GetUnitExp()[0] != INT_MIN ||
+        MHO_Unit("m^2147483647*m^-1").GetUnitExp()[0] != INT_MAX - 1 ||
+        MHO_Unit("m^-2147483647/m").GetUnitExp()[0] != INT_MIN)
+        noverflow++;
+    nfail += noverflow;
+
+    double nstr = cps.size();
+    printf("# validation of %zu dirty strings, %ld rejected\n", cps.size(),
+           nbad);
+    printf("%14s %14s %10s\n", "validation", "allocs/string", "ns/string");
+    printf("%14s %14s %10.1f\n", "MHO_Unit(str)", "",
+           std::chrono::duration<double, std::nano>(t1 - t0).count() / nstr);
+    printf("%14s %14.2f %10.1f\n", "TryParse",
+           (nalloc.load() - n0) / nstr,
+           std::chrono::duration<double, std::nano>(t3 - t2).count() / nstr);
+    if (nfail - noverflow)
+        printf("  TryParse: %d results differ from Flex/Bison\n",
+               nfail - noverflow);
+    if (noverflow)
+        printf("  TryParse: %d wrong on exponent overflow\n", noverflow);
+    if (fail_allocs) {
+        printf("  TryParse: %ld allocations on the failure path\n",
+               fail_allocs);
+        nfail++;
+    }
+    return nfail;
+}
+
+// ns per lookup of the query units in a map of nunit units, by kind
+static int map_test(int nlook) {
+    const int nunit = 1000;
+    std::mt19937 rng(777);
+    std::vector<std::array<int, NMEAS>> keys;
+    std::unordered_set<MHO_Unit> distinct;
+    while ((int) keys.size() < nunit) {
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = (int) (rng() % 7) - 3;
+        if (distinct.insert(MHO_Unit(exp)).second) keys.push_back(exp);
+    }
+
+    std::unordered_map<MHO_Unit, int> hashed;
+    std::unordered_map<std::string, int> bystring;
+    std::map<MHO_Unit, int> ordered;
+    std::vector<std::pair<MHO_Unit, int>> flat;
+    std::unordered_set<size_t> hashes;
+    for (int i=0; i<nunit; i++) {
+        MHO_Unit u(keys[i]);
+        hashed.emplace(u, i);
+        bystring.emplace(u.GetUnitString(), i);
+        ordered.emplace(u, i);
+        flat.emplace_back(u, i);
+        hashes.insert(u.Hash());
+    }
+    std::sort(flat.begin(), flat.end());
+
+    std::vector<int> query(nlook);
+    for (int& q : query) q = rng() % nunit;
+
+    // Each query is a fresh unit, as the result of some computation
+    int nfail = 0;
+    const char *kind[4] = {"unordered", "by string", "std::map", "flat"};
+    printf("# map lookups, %d units, %d distinct hashes\n", nunit,
+           (int) hashes.size());
+    printf("%12s %10s\n", "map", "ns/lookup");
+    for (int k=0; k<4; k++) {
+        long nwrong = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int q : query) {
+            MHO_Unit u(keys[q]);
+            int val = -1;
+            if (k == 0) val = hashed.find(u)->second;
+            else if (k == 1) val = bystring.find(u.GetUnitString())->second;
+            else if (k == 2) val = ordered.find(u)->second;
+            else {
+                auto it = std::lower_bound(flat.begin(), flat.end(), u,
+                    [](const std::pair<MHO_Unit, int>& p, const MHO_Unit& v) {
+                        return p.first < v;
+                    });
+                val = it->second;
+            }
+            nwrong += (val != q);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        printf("%12s %10.1f\n", kind[k],
+               std::chrono::duration<double, std::nano>(t1 - t0).count()
+               / nlook);
+        if (nwrong) {
+            printf("  %s: %ld wrong lookups\n", kind[k], nwrong);
+            nfail++;
+        }
+    }
+    return nfail;
+}
+
+// Returns the number of failed checks
+static int intern_test(int nthreads) {
+    const int nunit = 2000;
+    std::mt19937 rng(31337);
+    std::vector<MHO_Unit> units;
+    for (int i=0; i<nunit; i++) {
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = (int) (rng() % 5) - 2;
+        units.emplace_back(exp);
+    }
+    MHO_UnitIntern intern;
+
+    // Every thread interns all the units, in its own order
+    std::vector<std::vector<MHO_UnitId> > ids(nthreads,
+                                              std::vector<MHO_UnitId>(nunit));
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; t++)
+        threads.emplace_back([&, t] {
+            for (int k=0; k<nunit; k++) {
+                int i = (t % 2) ? nunit - 1 - k : (k*7 + t) % nunit;
+                ids[t][i] = intern.Intern(units[i]);
+            }
+        });
+    for (auto& th : threads) th.join();
+
+    int nfail = 0;
+    std::unordered_set<MHO_Unit> distinct(units.begin(), units.end());
+    distinct.insert(MHO_Unit());
+    nfail += (intern.GetSize() != distinct.size());
+    for (int i=0; i<nunit; i++) {
+        MHO_UnitId id = ids[0][i], found = 0;
+        for (int t=1; t<nthreads; t++) nfail += (ids[t][i] != id);
+        nfail += (intern.GetUnit(id) != units[i]);
+        nfail += (intern.GetString(id) != units[i].GetUnitString());
+        nfail += !intern.Find(units[i], found) || found != id;
+    }
+    MHO_UnitId id;
+    nfail += !intern.Find(MHO_Unit(), id) || id != 0;
+    nfail += intern.Find(MHO_Unit("m^9"), id);
+
+    // Lookups, and a million IDs against a million units
+    const int nlook = 1 << 20;
+    std::vector<MHO_Unit> lu(nlook);
+    std::vector<MHO_UnitId> li(nlook);
+    for (int i=0; i<nlook; i++) {
+        lu[i] = units[rng() % nunit];
+        li[i] = intern.Intern(lu[i]);
+    }
+    long neq[2] = {0, 0};
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i=0; i<nlook; i++) neq[0] += intern.Find(lu[i], id);
+    auto t1 = std::chrono::steady_clock::now();
+    for (int i=0; i<nlook; i++) neq[0] += intern.GetUnit(li[i]).Hash() & 1;
+    auto t2 = std::chrono::steady_clock::now();
+    for (int i=1; i<nlook; i++) neq[0] += (lu[i] == lu[i - 1]);
+    auto t3 = std::chrono::steady_clock::now();
+    for (int i=1; i<nlook; i++) neq[1] += (li[i] == li[i - 1]);
+    auto t4 = std::chrono::steady_clock::now();
+    sink = neq[0] + neq[1];
+    auto ns = [&](auto a, auto b) {
+        return std::chrono::duration<double, std::nano>(b - a).count()
+            / nlook;
+    };
+    printf("# interning %d units from %d threads: %zu distinct, "
+           "%d wrong\n", nunit, nthreads, intern.GetSize(), nfail);
+    printf("%14s %8.2f ns\n%14s %8.2f ns\n%14s %8.2f ns (%zu bytes)\n"
+           "%14s %8.2f ns (%zu bytes)\n", "Find(unit)", ns(t0, t1),
+           "GetUnit(id)", ns(t1, t2), "unit == unit", ns(t2, t3),
+           sizeof(MHO_Unit), "id == id", ns(t3, t4), sizeof(MHO_UnitId));
+    return nfail;
+}
+
+// Returns the number of wrong results
+static int memo_test(int nthreads) {
+    const int nunit = 300, nop = 1 << 20;
+    std::mt19937 rng(2024);
+    MHO_UnitIntern intern;
+    std::vector<MHO_Unit> units;
+    std::vector<MHO_UnitId> ids;
+    for (int i=0; i<nunit; i++) {
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = (int) (rng() % 5) - 2;
+        units.emplace_back(exp);
+        ids.push_back(intern.Intern(units.back()));
+    }
+    std::vector<int> ia(nop), ib(nop);
+    for (int k=0; k<nop; k++) {
+        ia[k] = rng() % nunit;
+        ib[k] = rng() % 16;  // The same few products, over and over
+    }
+
+    // All the threads compute all the ops, cold; then check them
+    std::atomic<int> nwrong(0);
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; t++)
+        threads.emplace_back([&, t] {
+            int bad = 0;
+            for (int k=t; k<nop; k+=7) {
+                const MHO_Unit& a = units[ia[k]];
+                const MHO_Unit& b = units[ib[k]];
+                int n = ib[k] - 8;
+                bad += (intern.GetUnit(intern.Multiply(ids[ia[k]],
+                                                       ids[ib[k]])) != a*b);
+                bad += (intern.GetUnit(intern.Divide(ids[ia[k]],
+                                                     ids[ib[k]])) != a/b);
+                bad += (intern.GetUnit(intern.Power(ids[ia[k]], n)) !=
+                        (a^n));
+            }
+            nwrong += bad;
+        });
+    for (auto& th : threads) th.join();
+
+    long check[3] = {0, 0, 0};
+    auto t0 = std::chrono::steady_clock::now();
+    for (int k=0; k<nop; k++) {
+        MHO_Unit p = units[ia[k]] * units[ib[k]];
+        check[0] += (p == units[ib[k]]);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int k=0; k<nop; k++) {
+        MHO_UnitId p = intern.Multiply(ids[ia[k]], ids[ib[k]]);
+        check[1] += (p == ids[ib[k]]);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (int k=0; k<nop; k++) {
+        MHO_UnitId p = intern.Intern(units[ia[k]] * units[ib[k]]);
+        check[2] += (p == ids[ib[k]]);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    if (check[0] != check[1] || check[1] != check[2]) nwrong++;
+    sink = check[0];
+    auto ns = [&](auto a, auto b) {
+        return std::chrono::duration<double, std::nano>(b - a).count() / nop;
+    };
+    printf("# memoized algebra of %d unit IDs from %d threads: %d wrong\n"
+           "%24s %8.2f ns\n%24s %8.2f ns\n%24s %8.2f ns\n", nunit,
+           nthreads, nwrong.load(), "a*b, units", ns(t0, t1),
+           "a*b, IDs memoized", ns(t1, t2), "a*b, units then Intern",
+           ns(t2, t3));
+    return nwrong;
+}
+
+// ns per element of op over the n elements, the best of nrep runs
+template <typename F>
+static double per_elem_ns(size_t n, int nrep, F op) {
+    double best = 1e30;
+    for (int r=0; r<nrep; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        op();
+        auto t1 = std::chrono::steady_clock::now();
+        best = std::min(best,
+            std::chrono::duration<double, std::nano>(t1 - t0).count()/n);
+    }
+    return best;
+}
+
+// Returns the number of wrong results and missed errors
+static int array_test(int nrep) {
+    const size_t n = (1 << 20) + 37;  // A tail for the kernels
+    std::mt19937 rng(4242);
+    std::vector<MHO_Unit> a(n), b(n), c(n);
+    for (size_t i=0; i<n; i++) {
+        std::array<int, NMEAS> ea, eb;
+        for (int mu=0; mu<NMEAS; mu++) {
+            ea[mu] = (int) (rng() % 7) - 3;
+            eb[mu] = (rng() % 4) ? ea[mu] : (int) (rng() % 7) - 3;
+        }
+        a[i] = MHO_Unit(ea);
+        b[i] = MHO_Unit(eb);
+    }
+    std::vector<MHO_PackedUnit> pa, pb, pc(n);
+    for (size_t i=0; i<n; i++) {
+        pa.emplace_back(a[i]);
+        pb.emplace_back(b[i]);
+    }
+    // For the compatibility with a[0]: about half of d are a[0] times
+    // units of no dimension, such as Hz*s
+    const MHO_Unit one[4] = {MHO_Unit("Hz*s"), MHO_Unit("Jy*s^2/kg"),
+                             MHO_Unit("sr/rad^2"), MHO_Unit("deg/rad")};
+    std::vector<MHO_Unit> d(n);
+    for (size_t i=0; i<n; i++) {
+        d[i] = (rng() % 2) ? a[0] : b[i];
+        for (int k=0; k<4; k++) d[i] *= one[k] ^ ((int) (rng() % 3) - 1);
+    }
+    MHO_UnitArray ua(a), ub(b), uc, ud(d);
+    std::vector<uint8_t> mask(n);
+
+    printf("# unit arrays, %zu units, kernel %s, bytes/unit: "
+           "MHO_Unit %zu, MHO_PackedUnit %zu, MHO_UnitArray %d\n", n,
+           MHO_UnitArray::GetKernelName(), sizeof(MHO_Unit),
+           sizeof(MHO_PackedUnit), NMEAS);
+    printf("%12s %12s %12s %12s\n", "op", "ns MHO_Unit", "ns packed",
+           "ns array");
+    printf("%12s %12.3f %12.3f %12.3f\n", "a*b",
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) c[i] = a[i] * b[i]; }),
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) pc[i] = pa[i] * pb[i]; }),
+           per_elem_ns(n, nrep, [&] { uc = ua; uc *= ub; }));
+    printf("%12s %12.3f %12.3f %12.3f\n", "a/b",
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) c[i] = a[i] / b[i]; }),
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) pc[i] = pa[i] / pb[i]; }),
+           per_elem_ns(n, nrep, [&] { uc = ua; uc /= ub; }));
+    printf("%12s %12.3f %12.3f %12.3f\n", "a^3",
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) {
+                   c[i] = a[i];
+                   c[i].RaiseToPower(3);
+               } }),
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) pc[i] = pa[i] ^ 3; }),
+           per_elem_ns(n, nrep, [&] { uc = ua; uc ^= 3; }));
+    printf("%12s %12.3f %12.3f %12.3f\n", "a==b",
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) mask[i] = (a[i] == b[i]); }),
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++) mask[i] = (pa[i] == pb[i]); }),
+           per_elem_ns(n, nrep, [&] { mask = ua.EqualMask(ub); }));
+    printf("%12s %12.3f %12s %12.3f\n", "compatible",
+           per_elem_ns(n, nrep, [&] {
+               for (size_t i=0; i<n; i++)
+                   mask[i] = MHO_UnitDimension::Compatible(d[i], a[0]); }),
+           "-",
+           per_elem_ns(n, nrep, [&] { mask = ud.CompatibleMask(a[0]); }));
+
+    // The results against MHO_Unit, element by element
+    int nwrong = 0;
+    MHO_UnitArray prod = ua * ub, quot = ua / ub, cube = ua ^ 3, inv = ua;
+    inv.Invert();
+    std::vector<uint8_t> eq = ua.EqualMask(ub), eq0 = ua.EqualMask(a[0]);
+    for (size_t i=0; i<n; i++) {
+        MHO_Unit cu = a[i];
+        cu.RaiseToPower(3);
+        MHO_Unit iu = a[i];
+        iu.Invert();
+        nwrong += (prod.Get(i) != a[i] * b[i]) + (quot.Get(i) != a[i] / b[i])
+            + (cube.Get(i) != cu) + (inv.Get(i) != iu)
+            + (eq[i] != (a[i] == b[i])) + (eq0[i] != (a[i] == a[0]));
+    }
+    if (ua.ToUnits() != a || !(ua * ub / ub == ua)) nwrong++;
+
+    MHO_UnitArray same(n, a[7]);
+    if (!same.AllCompatible(a[7]) || same.AllCompatible(a[8])) nwrong++;
+    same.Set(n - 1, a[8]);
+    if (same.AllCompatible(a[7])) nwrong++;
+    if (!MHO_UnitArray().AllCompatible(a[0])) nwrong++;
+
+    std::vector<uint8_t> compat = ud.CompatibleMask(a[0]);
+    size_t ncompat = 0;
+    for (size_t i=0; i<n; i++) {
+        nwrong += (compat[i] != MHO_UnitDimension::Compatible(d[i], a[0]));
+        ncompat += compat[i];
+    }
+    if (ncompat < n/3 || ud.AllCompatible(a[0])) nwrong++;
+    if (!MHO_UnitArray(n, a[0] * one[0]).AllCompatible(a[0])) nwrong++;
+    compat = ud.CompatibleMask(MHO_Unit("s^-600"));
+    if (std::count(compat.begin(), compat.end(), 1)) nwrong++;
+
+    // Exponents out of the int8_t range, and mismatched sizes
+    MHO_UnitArray big(n - 1, MHO_Unit("m^100"));
+    big.PushBack(MHO_Unit("m"));
+    int nmissed = 0;
+    try { big * big; nmissed++; } catch (const std::overflow_error&) {}
+    try { big ^ 2; nmissed++; } catch (const std::overflow_error&) {}
+    try { big / (big ^ -1); nmissed++; } catch (const std::overflow_error&) {}
+    try { big.PushBack(MHO_Unit("m^200")); nmissed++; }
+    catch (const std::overflow_error&) {}
+    try { big * MHO_UnitArray(n + 1); nmissed++; }
+    catch (const std::invalid_argument&) {}
+    try { (big ^ 1) / big; } catch (...) { nmissed++; }
+
+    // In place, an overflow wraps the exponent around, whatever the
+    // kernel: 100^3 to 44, 100 + 100 to -56, -(-128) to -128
+    MHO_UnitArray wrap = big, sum = big, neg(n, MHO_Unit("m^-128"));
+    try { wrap ^= 3; } catch (const std::overflow_error&) {}
+    try { sum *= big; } catch (const std::overflow_error&) {}
+    try { neg ^= -1; } catch (const std::overflow_error&) {}
+    for (size_t i=0; i<n; i++) {
+        int last = (i == n - 1);
+        nwrong += (wrap.Get(i) != (last ? MHO_Unit("m^3") : MHO_Unit("m^44")))
+            + (sum.Get(i) != (last ? MHO_Unit("m^2") : MHO_Unit("m^-56")))
+            + (neg.Get(i) != MHO_Unit("m^-128"));
+    }
+    printf("  %d wrong results, %d missed errors\n", nwrong, nmissed);
+    return nwrong + nmissed;
+}
+
+// Returns the number of chains whose fused value differs from the steps
+static int chain_test() {
+    std::mt19937 rng(99);
+    std::vector<MHO_Unit> u;
+    for (int i=0; i<1000; i++) {
+        std::array<int, NMEAS> exp;
+        for (int mu=0; mu<NMEAS; mu++) exp[mu] = (int) (rng() % 7) - 3;
+        u.emplace_back(exp);
+    }
+    int nwrong = 0;
+    for (int i=0; i<1000; i++) {
+        const MHO_Unit& a = u[i];
+        const MHO_Unit& b = u[(i*7 + 1) % 1000];
+        const MHO_Unit& c = u[(i*13 + 2) % 1000];
+        MHO_Unit t1, t2, t3, t4;
+        t1 = a * b;
+        t2 = c ^ -3;
+        t3 = t1 / t2;
+        t4 = t3 * a;
+        MHO_Unit f = MHO_UnitRef(a) * b / (c ^ -3) * a;
+        nwrong += (f != t4) + ((a * b) / (c ^ -3) * a != t4);
+        nwrong += !(MHO_UnitRef(a) * b / (c ^ -3) * a ==
+                    MHO_UnitRef(a) / (c ^ -3) * b * a);
+        nwrong += ((MHO_UnitRef(a) * b).GetUnitString() !=
+                   t1.GetUnitString());
+        // A temporary operand, and the destination as an operand
+        nwrong += ((MHO_UnitRef(a) * MHO_Unit(b)) ^ 2) != (t1 ^ 2);
+        MHO_Unit w = c;
+        w = MHO_UnitRef(w) * a / (w ^ 2) * w;
+        nwrong += (w != a);
+        w *= MHO_UnitRef(b) / a;
+        nwrong += (w != b);
+        // A product of two units is an MHO_Unit, and expressions take
+        // strings
+        auto g = a * b;
+        g.Invert();
+        (a * b).RaiseToPower(2);
+        nwrong += (g != MHO_Unit() / t1);
+        nwrong += ((a * b) * std::string("kg") != t1 * std::string("kg"));
+        nwrong += ((MHO_UnitRef(a) * b) / "kg" != t1 / "kg");
+        nwrong += ("kg" * (MHO_UnitRef(a) * b) != "kg" * t1);
+    }
+    printf("# expression templates, 1000 chains: %d wrong\n", nwrong);
+    return nwrong;
+}
+
+//
+// The regression suite
+//
+struct BenchRecord {
+    std::string fCase;
+    double fNs;      // per op
+    double fAllocs;  // per op
+    long fRssKb;     // peak RSS of the process so far
+};
+
+static std::vector<BenchRecord> records;
+
+static long peak_rss_kb() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;  // kB on Linux
+}
+
+// Run op(i) for i in [0, nops) and record it under name
+template <typename F>
+static void bench_op(const char *name, long nops, F op) {
+    long n0 = nalloc.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (long i=0; i<nops; i++) op(i);
+    auto t1 = std::chrono::steady_clock::now();
+    double allocs = (nalloc.load() - n0) / (double) nops;
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count()
+        / nops;
+    records.push_back({name, ns, allocs, peak_rss_kb()});
+    printf("%-24s %10.1f %14.2f %12ld\n", name, ns, allocs,
+           records.back().fRssKb);
+}
+
+// An expression of depth parentheses around powers, m^(1)...
+static std::string nested_expr(int depth) {
+    std::string str;
+    for (int i=0; i<depth; i++) str += "(";
+    str += "kg*m/s^2";
+    for (int i=0; i<depth; i++) str += (i % 2) ? ")^-1" : ")^1";
+    return str;
+}
+
+static void run_suite(long nops) {
+    const std::vector<std::string> shorts = {
+        "m", "kg", "s", "Hz", "m/s^2", "kg*m/s^2", "rad/s", "Jy*sr"};
+    const std::vector<std::string> longs = {
+        "m * ((kg^2*s^-3/A)^-5 * K^5/cd/(mol*Hz)^3*s)^2 * rad * "
+        "Jy^(7 + 2*(4 - 6))",
+        " A * kg *(m^-1*s^-2)^3  ",
+        "kg^-1 * (m^-1 * s^-2)^(-3) / m^2 * mol * cd^2 * K^-4 * A / Jy"};
+    const std::vector<std::string> nested = {
+        nested_expr(8), nested_expr(32), nested_expr(64)};
+
+    printf("# regression suite\n");
+    printf("%-24s %10s %14s %12s\n", "case", "ns/op", "allocs/op",
+           "peak_rss_kb");
+
+    const char *pname[2][3] = {
+        {"parse_short_flexbison", "parse_long_flexbison",
+         "parse_nested_flexbison"},
+        {"parse_short_handwritten", "parse_long_handwritten",
+         "parse_nested_handwritten"}};
+    const std::vector<std::string> *sets[3] = {&shorts, &longs, &nested};
+    for (int eng=0; eng<2; eng++) {
+        MHO_Unit::SetEngine((MHO_Unit::Engine) eng);
+        for (int k=0; k<3; k++) {
+            const std::vector<std::string>& set = *sets[k];
+            bench_op(pname[eng][k], nops/(4*k + 1), [&](long i) {
+                sink = MHO_Unit(set[i % set.size()]).GetUnitExp()[1];
+            });
+        }
+    }
+    MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+
+    std::vector<MHO_Unit> u;
+    for (const auto& str : shorts) u.push_back(MHO_Unit(str));
+    for (const auto& str : longs) u.push_back(MHO_Unit(str));
+    size_t n = u.size();
+    std::vector<std::array<int, NMEAS>> exps;
+    for (const auto& v : u) exps.push_back(v.GetUnitExp());
+
+    MHO_Unit w;
+    w.GetUnitString();
+    bench_op("construct_string", nops, [&](long i) {
+        w.SetUnitExp(exps[i % n]);
+        sink = w.GetUnitString().size();
+    });
+    char buf[MHO_Unit::kMaxChars];
+    bench_op("to_chars", nops, [&](long i) {
+        sink = u[i % n].ToChars(buf, buf + sizeof(buf)).ptr - buf;
+    });
+
+    bench_op("op_mul", nops, [&](long i) {
+        sink = (u[i % n] * u[(i + 1) % n]).GetUnitExp()[0];
+    });
+    bench_op("op_div", nops, [&](long i) {
+        sink = (u[i % n] / u[(i + 1) % n]).GetUnitExp()[0];
+    });
+    bench_op("op_pow", nops, [&](long i) {
+        sink = (u[i % n] ^ (int) (i % 5 - 2)).GetUnitExp()[0];
+    });
+    bench_op("op_mul_assign", nops, [&](long i) {
+        w *= u[i % n];
+        sink = w.GetUnitExp()[0];
+    });
+    bench_op("op_div_assign", nops, [&](long i) {
+        w /= u[i % n];
+        sink = w.GetUnitExp()[0];
+    });
+    bench_op("op_mul_string", nops/4, [&](long i) {
+        sink = (u[i % n] * shorts[i % shorts.size()]).GetUnitExp()[0];
+    });
+    bench_op("op_div_string", nops/4, [&](long i) {
+        sink = (u[i % n] / shorts[i % shorts.size()]).GetUnitExp()[0];
+    });
+    bench_op("op_string_mul", nops/4, [&](long i) {
+        sink = (shorts[i % shorts.size()] * u[i % n]).GetUnitExp()[0];
+    });
+    bench_op("op_mul_assign_string", nops/4, [&](long i) {
+        w *= shorts[i % shorts.size()];
+        sink = w.GetUnitExp()[0];
+    });
+    // Fused into w, as MHO_Unit products reusing their temporary, and
+    // one default-constructed temporary per step
+    bench_op("op_chain", nops, [&](long i) {
+        w = MHO_UnitRef(u[i % n]) * u[(i + 1) % n] / (u[(i + 2) % n] ^ 2)
+            * u[(i + 3) % n];
+        sink = w.GetUnitExp()[0];
+    });
+    bench_op("op_chain_units", nops, [&](long i) {
+        w = (u[i % n] * u[(i + 1) % n]) / (u[(i + 2) % n] ^ 2)
+            * u[(i + 3) % n];
+        sink = w.GetUnitExp()[0];
+    });
+    bench_op("op_chain_steps", nops, [&](long i) {
+        MHO_Unit t1, t2, t3;
+        t1 = u[i % n] * u[(i + 1) % n];
+        t2 = u[(i + 2) % n] ^ 2;
+        t3 = t1 / t2;
+        w = t3 * u[(i + 3) % n];
+        sink = w.GetUnitExp()[0];
+    });
+    bench_op("op_eq", nops, [&](long i) {
+        sink = (u[i % n] == u[(i*7) % n]);
+    });
+    bench_op("op_ne", nops, [&](long i) {
+        sink = (u[i % n] != u[(i*7) % n]);
+    });
+}
+
+static int write_records(const char *path) {
+    FILE *fp = (std::string(path) == "-") ? stdout : fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        return 1;
+    }
+    fprintf(fp, "case,ns_per_op,allocs_per_op,peak_rss_kb\n");
+    for (const auto& r : records)
+        fprintf(fp, "%s,%.3f,%.3f,%ld\n", r.fCase.c_str(), r.fNs, r.fAllocs,
+                r.fRssKb);
+    if (fp != stdout) fclose(fp);
+    return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+
+    int niter = (argc > 1) ? atoi(argv[1]) : 20000;
+    int ncores = (int) std::thread::hardware_concurrency();
+    if (ncores < 1) ncores = 1;
+
+    std::vector<std::array<int, NMEAS>> ref;
+    for (const auto& str : corpus) ref.push_back(MHO_Unit(str).GetUnitExp());
+
+    // First, while the peak RSS is still that of the suite alone
+    run_suite(niter*10L);
+    int nfail = 0;
+    if (argc > 2) nfail += write_records(argv[2]);
+
+    for (int cached=0; cached<2; cached++) {
+        MHO_UnitCache::Enable(cached);
+        MHO_UnitCache::Clear();
+        double rate1 = 0;
+        printf("# parse thread scaling, %d cores, cache %s\n", ncores,
+               cached ? "on" : "off");
+        printf("%8s %14s %8s\n", "threads", "parses/s", "speedup");
+        for (int nth=1; nth<=2*ncores; nth*=2) {
+            int nbad;
+            double sec = parse_threads(nth, niter, ref, nbad);
+            double rate = (double) nth*niter*corpus.size() / sec;
+            if (nth == 1) rate1 = rate;
+            printf("%8d %14.0f %8.2f\n", nth, rate, rate/rate1);
+            if (nbad) {
+                printf("  %d wrong parses with %d threads\n", nbad, nth);
+                nfail += nbad;
+            }
+        }
+        if (cached) {
+            MHO_UnitCache::Stats st = MHO_UnitCache::GetStats();
+            printf("# cache: L1 hits %llu, L2 hits %llu, misses %llu, "
+                   "size %zu\n", (unsigned long long) st.fL1Hits,
+                   (unsigned long long) st.fL2Hits,
+                   (unsigned long long) st.fMisses, st.fSize);
+        }
+    }
+    MHO_UnitCache::Enable(false);
+
+    std::vector<MHO_Unit> units;
+    std::vector<MHO_PackedUnit> packed;
+    for (int i=0; i<1024; i++) {
+        MHO_Unit u = MHO_Unit(ref[i % ref.size()]) / MHO_Unit(ref[i % 7]);
+        units.push_back(u);
+        packed.push_back(MHO_PackedUnit(u));
+    }
+    long check[2] = {0, 0};
+    int nalg = niter/20 + 1;
+    printf("# unit algebra, ns/op\n");
+    printf("%-14s %6zu bytes %8.2f\n", "MHO_Unit", sizeof(MHO_Unit),
+           algebra_ns(units, nalg, check[0]));
+    printf("%-14s %6zu bytes %8.2f\n", "MHO_PackedUnit",
+           sizeof(MHO_PackedUnit), algebra_ns(packed, nalg, check[1]));
+    if (check[0] != check[1]) {
+        printf("  MHO_PackedUnit results differ from MHO_Unit\n");
+        nfail++;
+    }
+    // A power out of the int range throws, even in lanes of int32_t
+    std::array<int, 2> wide = {100000000, -3};
+    try {
+        MHO_BasicUnit<2, int32_t>(wide) ^ 100;
+        printf("  MHO_BasicUnit: int overflow of a power not detected\n");
+        nfail++;
+    }
+    catch (const std::overflow_error&) {}
+
+    std::vector<MHO_Unit> million;
+    for (int i=0; i<(1 << 20); i++) million.push_back(units[i % units.size()]);
+    int ncopy = 0;
+    printf("# %zu units of %zu bytes, ns/unit\n", million.size(),
+           sizeof(MHO_Unit));
+    const char *cname[3] = {"copy", "copy+sort", "memcpy x2"};
+    for (int how=0; how<3; how++)
+        printf("%10s %10.2f\n", cname[how], copy_ns(million, how, ncopy));
+    if (ncopy) {
+        printf("  %d copies differ from the originals\n", ncopy);
+        nfail++;
+    }
+
+    double sallocs;
+    std::string text[3];
+    printf("# text table of %zu units\n", million.size());
+    printf("%14s %14s %10s\n", "format", "allocs/unit", "ns/unit");
+    const char *fname[3] = {"GetUnitString", "ToChars", "std::format"};
+    int nhow = 2;
+#if defined(__cpp_lib_format)
+    nhow = 3;
+#endif
+    for (int how=0; how<nhow; how++) {
+        double ns = table_ns(million, how, text[how], sallocs);
+        printf("%14s %14.2f %10.1f\n", fname[how], sallocs, ns);
+        if (text[how] != text[0]) {
+            printf("  %s output differs from GetUnitString()\n", fname[how]);
+            nfail++;
+        }
+    }
+
+    // Like std::to_chars, ToChars() fits a buffer of exactly the length
+    // of the text, and no shorter one
+    int nfit = 0;
+    for (size_t i=0; i<1000; i++) {
+        std::string str = million[i].GetUnitString();
+        char buf[MHO_Unit::kMaxChars];
+        for (size_t len=0; len<=str.size(); len++) {
+            std::to_chars_result res = million[i].ToChars(buf, buf + len);
+            bool fits = (res.ec == std::errc());
+            nfit += (fits != (len == str.size())) ||
+                (fits && std::string_view(buf, res.ptr - buf) != str);
+        }
+    }
+    if (nfit) {
+        printf("  ToChars(): %d wrong results in short buffers\n", nfit);
+        nfail++;
+    }
+    million.clear();
+
+    unit_arena arena;
+    arena_init(&arena);
+    double allocs;
+    printf("# parse nodes, heap vs arena vs direct\n");
+    printf("%8s %14s %10s\n", "nodes", "allocs/parse", "ns/parse");
+    double ns = parse_nodes_ns(NULL, 0, nalg, allocs);
+    printf("%8s %14.2f %10.1f\n", "heap", allocs, ns);
+    ns = parse_nodes_ns(&arena, 0, nalg, allocs);
+    printf("%8s %14.2f %10.1f\n", "arena", allocs, ns);
+    ns = parse_nodes_ns(NULL, 1, nalg, allocs);
+    printf("%8s %14.2f %10.1f\n", "direct", allocs, ns);
+    arena_free(&arena);
+
+    int nvalid;
+    std::vector<std::string> cps = gen_corpus(100000, 0.2, 12345);
+    int ndiff = engines_differ(cps, nvalid);
+    printf("# engines, %zu random strings (%d valid): %d differ\n",
+           cps.size(), nvalid, ndiff);
+    nfail += ndiff;
+    printf("%12s %10s\n", "engine", "ns/parse");
+    printf("%12s %10.1f\n", "FlexBison", engine_ns(MHO_Unit::kFlexBison, nalg));
+    printf("%12s %10.1f\n", "HandWritten",
+           engine_ns(MHO_Unit::kHandWritten, nalg));
+
+    std::vector<std::string_view> views(cps.begin(), cps.end());
+    std::vector<std::array<int, NMEAS>> exps(views.size());
+    std::vector<MHO_UnitParser::Error> errs(views.size());
+    printf("# ParseMany thread scaling, %zu strings\n", views.size());
+    printf("%8s %14s %8s\n", "threads", "parses/s", "speedup");
+    double rate1 = 0;
+    for (int nth=1; nth<=2*ncores; nth*=2) {
+        size_t nbad = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int it=0; it<10; it++)
+            nbad = MHO_Unit::ParseMany(views, exps, errs, nth);
+        auto t1 = std::chrono::steady_clock::now();
+        double rate = 10.0*views.size()
+            / std::chrono::duration<double>(t1 - t0).count();
+        if (nth == 1) rate1 = rate;
+        printf("%8d %14.0f %8.2f\n", nth, rate, rate/rate1);
+        if (nbad != views.size() - nvalid) {
+            printf("  ParseMany: %zu invalid strings, expected %zu\n", nbad,
+                   views.size() - nvalid);
+            nfail++;
+        }
+    }
+
+    // Bursts of small batches, on the threads kept by the MHO_WorkerPool,
+    // and batches from several threads at once, which find it busy
+    {
+        const size_t nburst = std::min<size_t>(1000, views.size());
+        const unsigned nth = 4;
+        std::span<const std::string_view> burst(views.data(), nburst);
+        std::vector<std::array<int, NMEAS>> want(nburst);
+        MHO_Unit::ParseMany(burst, want, {}, 1);
+        int nrep = niter/20 + 10;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int it=0; it<nrep; it++)
+            MHO_Unit::ParseMany(burst, exps, {}, nth);
+        auto t1 = std::chrono::steady_clock::now();
+        int nwrong = !std::equal(want.begin(), want.end(), exps.begin());
+        std::vector<std::thread> callers;
+        std::atomic<int> ncwrong(0);
+        for (int c=0; c<4; c++)
+            callers.emplace_back([&] {
+                std::vector<std::array<int, NMEAS>> got(nburst);
+                for (int it=0; it<nrep/4 + 1; it++) {
+                    MHO_Unit::ParseMany(burst, got, {}, nth);
+                    ncwrong += !std::equal(want.begin(), want.end(),
+                                           got.begin());
+                }
+            });
+        for (auto& th : callers) th.join();
+        printf("# ParseMany bursts of %zu strings, %d threads: %.1f us/batch,"
+               " %d wrong\n", nburst, nth,
+               std::chrono::duration<double, std::micro>(t1 - t0).count()
+               / nrep, nwrong + ncwrong.load());
+        nfail += nwrong + ncwrong.load();
+    }
+
+    std::vector<std::string> syms = gen_registry(500, 4321);
+    long lcheck = 0;
+    int nlook = niter/200 + 1;
+    printf("# symbol lookup, %zu units registered, ns/lookup\n",
+           MHO_UnitRegistry::GetInstance().GetSize());
+    printf("%12s %10.1f\n", "registry", lookup_ns(syms, false, nlook, lcheck));
+    printf("%12s %10.1f\n", "linear", lookup_ns(syms, true, nlook, lcheck));
+    for (int eng=0; eng<2; eng++) {
+        MHO_Unit::SetEngine((MHO_Unit::Engine) eng);
+        std::array<int, NMEAS> exp;
+        MHO_UnitRegistry::GetInstance().Lookup(syms[0], exp);
+        std::string str = syms[0] + "^2 / m";
+        MHO_Unit got(str), want = (MHO_Unit(exp) ^ 2) / MHO_Unit("m");
+        if (got.GetUnitExp() != want.GetUnitExp()) {
+            printf("  engine %d: wrong parse of registered unit \"%s\"\n",
+                   eng, str.c_str());
+            nfail++;
+        }
+    }
+    MHO_Unit::SetEngine(MHO_Unit::kFlexBison);
+
+    nfail += scaling_test();
+    nfail += fields_test();
+    nfail += validate_test(cps);
+    nfail += binary_test(cps);
+    nfail += map_test(niter*50);
+    nfail += intern_test(4);
+    nfail += memo_test(4);
+    nfail += array_test(niter/2000 + 3);
+    nfail += chain_test();
+
+    int nconv = convert_differ<double>() + convert_differ<float>();
+    double fac = MHO_UnitConversion("MHz", "Hz").GetFactor();
+    if (fac != 1e6 || MHO_UnitConversion("deg", "m").IsValid()) nconv++;
+    if (MHO_UnitConversion("Hz", "s^-1").GetFactor() != 1.0 ||
+        MHO_UnitConversion("Jy", "kg*s^-2").GetFactor() != 1e-26 ||
+        MHO_UnitConversion("rad", "sr").IsValid())
+        nconv++;
+    const double kDeg = 3.14159265358979323846/180;
+    if (std::abs(MHO_UnitConversion("deg^-3", "rad^-3").GetFactor()*kDeg*
+                 kDeg*kDeg - 1) > 1e-15 ||
+        std::abs(MHO_UnitConversion("sr", "deg^2").GetFactor()*kDeg*kDeg
+                 - 1) > 1e-15)
+        nconv++;
+    // A plan cached before a registration that changes the meaning of
+    // its string is not used after it
+    MHO_UnitRegistry& reg = MHO_UnitRegistry::GetInstance();
+    reg.Register("bqq", "m");
+    if (MHO_UnitConversion("mbqq", "m").GetFactor() != 1e-3) nconv++;
+    reg.Register("mbqq", "s");
+    if (MHO_UnitConversion("mbqq", "m").IsValid() ||
+        MHO_UnitConversion("mbqq", "s").GetFactor() != 1.0)
+        nconv++;
+    printf("# unit conversion, 1M values, kernel %s: %d wrong\n",
+           MHO_UnitConversion::GetKernelName(), nconv);
+    nfail += nconv;
+    std::vector<double> dvals(1 << 20, 1.5);
+    std::vector<float> fvals(1 << 20, 1.5f);
+    int ncv = niter/400 + 1;
+    printf("%12s %8s %12s %12s\n", "conversion", "type", "ns/val simd",
+           "ns/val loop");
+    printf("%12s %8s %12.3f %12.3f\n", "MHz->Hz", "double",
+           convert_ns(dvals, "MHz", "Hz", true, ncv),
+           convert_ns(dvals, "MHz", "Hz", false, ncv));
+    printf("%12s %8s %12.3f %12.3f\n", "deg->rad", "float",
+           convert_ns(fvals, "deg", "rad", true, ncv),
+           convert_ns(fvals, "deg", "rad", false, ncv));
+    printf("%12s %8s %12.3f %12.3f\n", "mJy->Jy", "float",
+           convert_ns(fvals, "mJy", "Jy", true, ncv),
+           convert_ns(fvals, "mJy", "Jy", false, ncv));
+
+    return nfail ? 1 : 0;
+}
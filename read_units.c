@@ -1,8 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "read_units.h"
-#include "read_units.lex.h"
 #include "read_units.tab.h"
+#include "read_units.lex.h"
 
 /*
  * Table of measurement units
@@ -21,9 +22,12 @@ int main(void) {
 
     /* char const meas_exp[] = " A * kg *(m^-1*s^-2)^3  "; */
         
+    yyscan_t scanner;
     YY_BUFFER_STATE buf;
+    YYSTYPE lval;
 
-    buf = yy_scan_string(meas_exp);
+    if (yylex_init(&scanner)) return 2;
+    buf = yy_scan_string(meas_exp, scanner);
 
     printf("Measurement expression:\n \"%s\"\n\n", meas_exp);
 
@@ -31,12 +35,12 @@ int main(void) {
 
     printf("Lexical analysis:\n");
     
-    while(tok = yylex())
+    while(tok = yylex(&lval, scanner))
         switch (tok) {
         case T_symbol:
-            printf("'%s' ", yylval.s); break;
+            printf("'%s' ", lval.s); free(lval.s); break;
         case T_number:
-            printf("'%d' ", yylval.d); break;
+            printf("'%d' ", lval.d); break;
         case '+': case '-': case '*': case '/':
         case '^': case '(': case ')':
             printf("%c ", tok); break;
@@ -45,18 +49,19 @@ int main(void) {
     printf("Parsing this expression as AST tree:\n\n");
     
 
-    yy_delete_buffer(buf);
+    yy_delete_buffer(buf, scanner);
 
     /*
      * Parse
      */
-    buf = yy_scan_string(meas_exp);
+    buf = yy_scan_string(meas_exp, scanner);
 
     /* 
      * Pointer to the list (actually, itself a pointer to the head of the list
      * of measures with their exponents
      * 
      */
+    parse_ctx ctx = {0};
     expr_list *el; 
 
     /*
@@ -70,7 +75,8 @@ int main(void) {
      */
 
     int perr;
-    if (perr = yyparse(&el)) return perr;  /* ======== ERROR ======== >>> */
+    if (perr = yyparse(scanner, &ctx)) return perr; /* ===== ERROR ===== >>> */
+    el = ctx.explst;
     
     printf("\n");
     printf("The list of measures with their exponents found in expression:\n");
@@ -87,7 +93,8 @@ int main(void) {
 
     printf("\n");
     
-    yy_delete_buffer(buf);
+    yy_delete_buffer(buf, scanner);
+    yylex_destroy(scanner);
 
 
     /*
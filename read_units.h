@@ -2,6 +2,11 @@
  * Declarations for read_units lexer/parser
  */
 
+#ifndef READ_UNITS_H
+#define READ_UNITS_H
+
+#include <stddef.h>
+
 #define NMEAS 12
 
 typedef unsigned char uchar;
@@ -38,48 +43,100 @@ typedef struct expr_list {
   struct expr_list *next;
 } expr_list;
 
+/* Block of a bump allocator */
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t size;   /* bytes available after the header */
+  size_t used;
+} arena_block;
+
+/* Bump allocator (arena) for the nodes of a parse */
+typedef struct unit_arena {
+  arena_block *head;  /* current block, followed by the older ones */
+} unit_arena;
+
+#define ARENA_BLOCK_SIZE 4096
+
 /* Positional representation of measure expression */
 typedef struct meas_pow {
     int exp[NMEAS];  /* powers of the units */
 } meas_pow;
 
+/*
+ * Per-call parser context. The parser is reentrant, so everything a single
+ * parse produces lives here rather than in globals. The caller owns it.
+ */
+typedef struct parse_ctx {
+    expr_list *explst;  /* list of measures with their powers (the result) */
+    unit_arena *arena;  /* if not NULL, the nodes are allocated from it */
+    int direct;         /* if set, no AST and no list: the powers are */
+    meas_pow mpow;      /* reduced on the fly straight into mpow */
+    /*
+     * Symbol lookup for the direct mode: sets *mpow to the powers of sym
+     * and returns nonzero if it is known. If NULL, getmeas() is used.
+     */
+    int (*lookup)(const void *registry, const char *sym, meas_pow *mpow);
+    const void *registry;
+} parse_ctx;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/* build an AST */
-ast_node *newast(int nodetype, ast_node *l, ast_node *r);
-ast_node *newnum(int d);
-ast_node *newmeas(int measure);
-expr_list *newexpr(int measure, int power, expr_list *next);
+/* Arena: the nodes are freed all at once by arena_reset() or arena_free() */
+void arena_init(unit_arena *ar);
+void *arena_alloc(unit_arena *ar, size_t size);
+void arena_reset(unit_arena *ar);
+void arena_free(unit_arena *ar);
+
+/* build an AST (nodes from the arena ar, or from the heap if ar is NULL) */
+ast_node *newast(unit_arena *ar, int nodetype, ast_node *l, ast_node *r);
+ast_node *newnum(unit_arena *ar, int d);
+ast_node *newmeas(unit_arena *ar, int measure);
+expr_list *newexpr(unit_arena *ar, int measure, int power, expr_list *next);
 expr_list *concat(expr_list *const expl, expr_list *const expr);
 void mulpwr(expr_list *const exp, int pwr);
 int getmeas(char const *sym);
+/* *val = (int) pow(base, pwr), in integers; -1 if it overflows, else 0 */
+int ipow(int base, int pwr, int *val);
 void print_tree(ast_node *a);
 void print_list(expr_list *const expr);
                 
-/* Reduce an AST into a linked list */
-expr_list *reduce(ast_node *a, expr_list *head);
+/* Direct mode: operations on arrays of measure powers */
+void mpow_meas(meas_pow *mpow, int measure);  /* mpow = measure^1 */
+/* The operations return -1 if a power overflows an int, else 0 */
+int mpow_mul(meas_pow *mpow, const meas_pow *rhs);  /* mpow *= rhs */
+int mpow_div(meas_pow *mpow, const meas_pow *rhs);  /* mpow /= rhs */
+int mpow_pow(meas_pow *mpow, int pwr);              /* mpow ^= pwr */
+
+/* Reduce an AST into a linked list; *overflow (if not NULL) is set to 1
+ * if a power is out of the int range, else to 0 */
+expr_list *reduce(unit_arena *ar, ast_node *a, expr_list *head,
+                  int *overflow);
     
 /* Reduce an AST into a linked list and free tree node memory */
-expr_list *reduce_and_free(ast_node *a, expr_list *head);
+expr_list *reduce_and_free(unit_arena *ar, ast_node *a, expr_list *head,
+                           int *overflow);
 
 /* Delete and free an AST */
-void treefree(ast_node *);
+void treefree(unit_arena *ar, ast_node *);
 
 /* Delete and free a measure expression list */
-void free_list(expr_list *);
+void free_list(unit_arena *ar, expr_list *);
 
 /* Convert measurement expression from list into array of measure powers */
 void explst_to_arr(expr_list *explst, meas_pow *mpow);
 
 /* Convert measurement expression from list form into array of measure powers.
  * Free the list. */
-void explst_to_arr_and_free(expr_list *explst, meas_pow *mpow);
+void explst_to_arr_and_free(unit_arena *ar, expr_list *explst,
+                            meas_pow *mpow);
     
 /* interface to the lexer */
-void yyerror(expr_list **el, const char *s, ...);
+void yyerror(void *scanner, parse_ctx *ctx, const char *s, ...);
 
 #ifdef __cplusplus
 }
 #endif
+
+#endif /* READ_UNITS_H */
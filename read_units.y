@@ -3,11 +3,10 @@
  */
 %{
     
+#include <limits.h>
 #include <stdio.h>
-#include <math.h>
+#include <stdlib.h>
 #include "read_units.h"
-    
-int yylex(void);
  
 /*
  * The positions of the measurement unit powers in array of exponents
@@ -32,15 +31,46 @@ int yylex(void);
 /*                     i_temp, i_lumi, i_mole, i_freq, i_ang_rad, i_ang_deg, */
 /*                     i_solid_ang, i_Jansky}; */
 
+/*
+ * Bison grows its stacks on the heap, so nesting costs no C stack; the
+ * default cap of 10000 entries would reject machine-generated expressions
+ * nested a few thousand deep. A level of parentheses takes an entry or
+ * two, so this allows inputs of megabytes.
+ */
+#define YYMAXDEPTH 10000000
+
+/* Reject an exponent or a unit power out of the int range */
+#define EXP_OVERFLOW                                    \
+    do {                                                \
+        yyerror(scanner, ctx, "exponent overflow");     \
+        YYERROR;                                        \
+    } while (0)
+
 %}
 
-%parse-param { expr_list **explst }
+/*
+ * Pure (reentrant) parser: no global state. The scanner state and the
+ * per-call parse context are passed in by the caller of yyparse().
+ */
+%define api.pure full
+
+%code requires {
+#include "read_units.h"
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+}
+
+%lex-param   { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { parse_ctx *ctx }
 
 /*
  * Parse stack element
  */
 %union {
     ast_node *a;
+    meas_pow  m;  /* symex in the direct mode */
     char  *s;
     int    d;
 }
@@ -50,12 +80,21 @@ int yylex(void);
 %token <s> T_SI_prefix
 %token <s> T_symbol
 
+/* Symbols strdup()-ed by the lexer and discarded on a syntax error */
+%destructor { free($$); } <s>
+
+%code {
+/* Reentrant scanner generated by Flex with %option bison-bridge */
+int yylex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+}
 
 /* Declare type for the expression (nonterminal symbol) */
 /* %type <s> exp */
 %type <d> numex
-%type <d> measure 
-%type <a> symex
+/*
+ * symex and measure have no declared type: symex is an AST node <a>, or,
+ * if ctx->direct is set, the array of unit powers <m> reduced on the fly
+ */
 
 /* Declare precedence and associativity */
 /* Operators are declared in increasing order of precedence */
@@ -70,40 +109,136 @@ int yylex(void);
 
 exprsn:  numex YYEOF
                {
-                 yyerror(explst, "no measurement units, just number: %d", $1);
+                 yyerror(scanner, ctx,
+                         "no measurement units, just number: %d", $1);
                  YYERROR;
                }
-        | symex YYEOF   { ast_node *a = $1;
-                          *explst = reduce_and_free($1, 0);
-                          expr_list *el1 = *explst;
-        }
-        | YYEOF         { yyerror(explst, "empty string."); YYERROR; }
+        | symex YYEOF   {
+                          int ovf = 0;
+                          if (ctx->direct)
+                            ctx->mpow = $<m>1;
+                          else
+                            ctx->explst = reduce_and_free(ctx->arena,
+                                                          $<a>1, 0, &ovf);
+                          if (ovf) {
+                            free_list(ctx->arena, ctx->explst);
+                            ctx->explst = 0;
+                            EXP_OVERFLOW;
+                          }
+                        }
+        | YYEOF         { yyerror(scanner, ctx, "empty string."); YYERROR; }
 ;
 
-symex:  measure              { $$ = newmeas($1); }
-        | symex '*' symex    { $$ = newast('*', $1, $3); }
-        | symex '/' symex    { $$ = newast('/', $1, $3);  }
-        | symex '^' numex    { ast_node *ipow = newnum($3);
-                               $$ = newast('^', $1, ipow); }
-        | '(' symex ')'      { $$ = $2; }
+symex:  measure              {
+                               if (ctx->direct)
+                                 $<m>$ = $<m>1;
+                               else
+                                 $<a>$ = newmeas(ctx->arena, $<d>1);
+                             }
+        | symex '*' symex    {
+                               if (ctx->direct) {
+                                 $<m>$ = $<m>1;
+                                 if (mpow_mul(&$<m>$, &$<m>3))
+                                   EXP_OVERFLOW;
+                               }
+                               else
+                                 $<a>$ = newast(ctx->arena, '*', $<a>1, $<a>3);
+                             }
+        | symex '/' symex    {
+                               if (ctx->direct) {
+                                 $<m>$ = $<m>1;
+                                 if (mpow_div(&$<m>$, &$<m>3))
+                                   EXP_OVERFLOW;
+                               }
+                               else
+                                 $<a>$ = newast(ctx->arena, '/', $<a>1, $<a>3);
+                             }
+        | symex '^' numex    {
+                               if (ctx->direct) {
+                                 $<m>$ = $<m>1;
+                                 if (mpow_pow(&$<m>$, $3))
+                                   EXP_OVERFLOW;
+                               }
+                               else {
+                                 ast_node *ipow = newnum(ctx->arena, $3);
+                                 $<a>$ = newast(ctx->arena, '^', $<a>1, ipow);
+                               }
+                             }
+        | '(' symex ')'      {
+                               if (ctx->direct)
+                                 $<m>$ = $<m>2;
+                               else
+                                 $<a>$ = $<a>2;
+                             }
 ;
 
-measure: T_symbol    { $$ = getmeas($1);
-                       if ($$ == -1) {
-                         yyerror(explst, "no such measurement unit: '%s'", $1);
+/*
+ * measure is the index <d> of a base unit in meas_tab, or, in the direct
+ * mode, its powers <m>. The direct mode looks the symbol up with
+ * ctx->lookup, if it is set, so it also knows the registered units.
+ */
+measure: T_symbol    { int found;
+                       if (ctx->direct && ctx->lookup)
+                         found = ctx->lookup(ctx->registry, $1, &$<m>$);
+                       else {
+                         int mu = getmeas($1);
+                         found = (mu != -1);
+                         if (ctx->direct && found)
+                           mpow_meas(&$<m>$, mu);
+                         else
+                           $<d>$ = mu;
+                       }
+                       if (!found) {
+                         yyerror(scanner, ctx,
+                                 "no such measurement unit: '%s'", $1);
+                         free($1);
                          YYERROR;
                        }
+                       free($1); /* strdup()-ed by the lexer */
                      }
 ;
 
-numex:  T_number                 { $$ = $1;         }
-        | numex '+' numex        { $$ = $1 + $3;    }
-        | numex '-' numex        { $$ = $1 - $3;    }
-        | '-' numex  %prec NEG   { $$ = -$2;        }
+/*
+ * The exponent arithmetic is checked: a value out of the int range (a
+ * number literal too, which the lexer gives as -1) is an error, as it is
+ * kOverflow in MHO_UnitParser.
+ */
+numex:  T_number                 {
+                                   if ($1 < 0) EXP_OVERFLOW;
+                                   $$ = $1;
+                                 }
+        | numex '+' numex        {
+                                   if (__builtin_add_overflow($1, $3, &$$))
+                                     EXP_OVERFLOW;
+                                 }
+        | numex '-' numex        {
+                                   if (__builtin_sub_overflow($1, $3, &$$))
+                                     EXP_OVERFLOW;
+                                 }
+        | '-' numex  %prec NEG   {
+                                   if (__builtin_sub_overflow(0, $2, &$$))
+                                     EXP_OVERFLOW;
+                                 }
         | '+' numex  %prec POS   { $$ = $2;        }
-        | numex '*' numex        { $$ = $1 * $3;    }
-        | numex '/' numex        { $$ = $1 / $3;    }
-        | numex '^' numex        { $$ = (int) pow($1, $3); }
+        | numex '*' numex        {
+                                   if (__builtin_mul_overflow($1, $3, &$$))
+                                     EXP_OVERFLOW;
+                                 }
+        | numex '/' numex        {
+                                   if ($3 == 0) {
+                                     yyerror(scanner, ctx, "division by zero");
+                                     YYERROR;
+                                   }
+                                   if ($1 == INT_MIN && $3 == -1) EXP_OVERFLOW;
+                                   $$ = $1 / $3;
+                                 }
+        | numex '^' numex        {
+                                   if ($1 == 0 && $3 < 0) {
+                                     yyerror(scanner, ctx, "division by zero");
+                                     YYERROR;
+                                   }
+                                   if (ipow($1, $3, &$$)) EXP_OVERFLOW;
+                                 }
         | '(' numex ')'          { $$ = $2;         }
 ;
 %%
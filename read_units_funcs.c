@@ -7,8 +7,6 @@
 #  include <string.h>
 #  include "read_units.h"
 
-expr_list *explst;
-
 /*
  * Table of measurement units
  */
@@ -16,15 +14,33 @@ char const *const meas_tab[NMEAS] = \
     {"m", "kg", "s", "A", "K", "cd", "mol", "Hz", "rad", "deg", "sr", "Jy"};
 
 
-ast_node *
-newast(int nodetype, ast_node *l, ast_node *r)
+/*
+ * Node memory: from the arena ar if it is not NULL, otherwise from the heap.
+ * The nodes of an arena are not freed one by one, but all at once by
+ * arena_reset() or arena_free().
+ */
+static void *node_alloc(unit_arena *ar, size_t size)
 {
-    ast_node *a = (ast_node *) malloc(sizeof(ast_node));
-  
-  if(!a) {
-    yyerror(&explst, "out of space");
+  void *p = ar ? arena_alloc(ar, size) : malloc(size);
+
+  if(!p) {
+    yyerror(NULL, NULL, "out of space");
     exit(0);
   }
+  return p;
+}
+
+static void node_free(unit_arena *ar, void *p)
+{
+  if (!ar) free(p);
+}
+
+
+ast_node *
+newast(unit_arena *ar, int nodetype, ast_node *l, ast_node *r)
+{
+  ast_node *a = (ast_node *) node_alloc(ar, sizeof(ast_node));
+
   a->nodetype = nodetype;
   a->l = l;
   a->r = r;
@@ -33,14 +49,10 @@ newast(int nodetype, ast_node *l, ast_node *r)
 
 
 ast_node *
-newnum(int d)
+newnum(unit_arena *ar, int d)
 {
-    num_leaf *a = (num_leaf *) malloc(sizeof(num_leaf));
-  
-  if(!a) {
-    yyerror(&explst, "out of space");
-    exit(0);
-  }
+  num_leaf *a = (num_leaf *) node_alloc(ar, sizeof(num_leaf));
+
   a->nodetype = 'K';
   a->number = d;
   return (ast_node *)a;
@@ -48,14 +60,10 @@ newnum(int d)
 
 
 ast_node *
-newmeas(int measure)
+newmeas(unit_arena *ar, int measure)
 {
-    meas_leaf *a = (meas_leaf *) malloc(sizeof(meas_leaf));
-  
-  if(!a) {
-    yyerror(&explst, "out of space");
-    exit(0);
-  }
+  meas_leaf *a = (meas_leaf *) node_alloc(ar, sizeof(meas_leaf));
+
   a->nodetype = 'M';
   a->measure = measure;
   return (ast_node *)a;
@@ -63,18 +71,10 @@ newmeas(int measure)
 
 
 expr_list *
-newexpr(int measure, int power, expr_list *next)
+newexpr(unit_arena *ar, int measure, int power, expr_list *next)
 {
-    expr_list *ep = (expr_list *) malloc(sizeof(expr_list));
-  
-  if(!ep) {
-    yyerror(&explst, "out of space");
-    exit(0);
-  }
+  expr_list *ep = (expr_list *) node_alloc(ar, sizeof(expr_list));
 
-  /* int imea = 0x0ff & measure; */
-  /* printf("newexpr: ep = %p, next = %p, '%s'\n", ep, next, measures[imea]); */
-  
   ep->measure = measure;
   ep->power = power;
   ep->next = next;
@@ -82,256 +82,184 @@ newexpr(int measure, int power, expr_list *next)
 }
 
 
-/* 
- * Reduce the abstract syntax tree (pointed at by a) to the linked list 
- * (pointed at by head) of elements {measure,power}
- *
- * The tree memory is freed.
+/*
+ * Explicit stack for the walks over an AST below. They are iterative, so
+ * the depth of a tree is limited by the heap, not by the C stack: the
+ * first WALK_STACK_INIT entries are in the walk_stack itself, the rest
+ * come from the heap.
  */
+#define WALK_STACK_INIT 64
 
-expr_list *reduce_and_free(ast_node *a, expr_list *head) {
-    
-    int pwr, meas;
-    num_leaf *numleaf;
-    meas_leaf *measleaf;
-    expr_list *exp, *expl, *expr;
-    ast_node *nodl, *nodr;
-
-    /*
-     * If the measure expression consists of just a measurement unit 
-     * without operators, no need for the recursive tree reduction.
-     * The AST tree has the only leaf.
-     * 
-     */
-    if (a->nodetype == 'M') {
-        measleaf = (meas_leaf *) a;
-        exp = newexpr(measleaf->measure, 1, head);
-        /* Delete the one-leaf tree */
-        free(a);
-        return exp;
-    }
-    
-    /* 
-     * Dive into recursion 
-     */
-    switch(a->nodetype) {
-    case '^': {
-        numleaf = (num_leaf *) a->r;
-        if (numleaf->nodetype != 'K') {
-            printf("Error: non-numeric power exponent, node type  %c\n",
-                   numleaf->nodetype);
-            return 0;
-        }
-        pwr = numleaf->number;
-
-        nodl = a->l;
-        if (nodl->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodl;
-            exp = newexpr(measleaf->measure, pwr, head);
-            /* Delete left leaf */
-            free(nodl);
-        }
-        else {
-            exp = reduce_and_free(nodl, head);  /* ======= Recurse ====== >> */
-            /* Multiply powers of every list item by pwr */
-            mulpwr(exp, pwr);
-        }
-        break;
-    }
-      
-    case '*': {
-        nodl = a->l;
-        if (nodl->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodl;
-            expl = newexpr(measleaf->measure, 1, head);
-            /* Delete left leaf */
-            free(nodl);
-        }
-        else
-            expl = reduce_and_free(nodl, head); /* ======= Recurse ====== >> */
-        
-        nodr = a->r;
-        if (nodr->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodr;
-            expr = newexpr(measleaf->measure, 1, head);
-            /* Delete right leaf */
-            free(nodr);
-        }
-        else
-            expr = reduce_and_free(nodr, head); /* ======= Recurse ====== >> */
+typedef struct walk_item {
+  ast_node *node;
+  int mult;       /* product of the powers of the node's ancestors */
+} walk_item;
 
-        exp = concat(expl, expr);
-        
-        break;
+typedef struct walk_stack {
+  walk_item *item;
+  size_t n, cap;
+  walk_item init[WALK_STACK_INIT];
+} walk_stack;
+
+static void walk_init(walk_stack *st)
+{
+  st->item = st->init;
+  st->n = 0;
+  st->cap = WALK_STACK_INIT;
+}
+
+static void walk_push(walk_stack *st, ast_node *node, int mult)
+{
+  if (st->n == st->cap) {
+    walk_item *item = (walk_item *) malloc(2*st->cap*sizeof(walk_item));
+    if(!item) {
+      yyerror(NULL, NULL, "out of space");
+      exit(0);
     }
-      
-    case '/': {
-        nodl = a->l;
-        if (nodl->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodl;
-            expl = newexpr(measleaf->measure, 1, head);
-            /* Delete left leaf */
-            free(nodl);
-        }
-        else
-            expl = reduce_and_free(nodl, head); /* ======= Recurse ====== >> */
-        
-        nodr = a->r;
-        if (nodr->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodr;
-            expr = newexpr(measleaf->measure, -1, head);
-            /* Delete right leaf */
-            free(nodr);
-        }
-        else {
-            expr = reduce_and_free(nodr, head); /* ======= Recurse ====== >> */
-            /* Multiply powers of every list item by -1 */
-            mulpwr(expr, -1);
+    memcpy(item, st->item, st->n*sizeof(walk_item));
+    if (st->item != st->init) free(st->item);
+    st->item = item;
+    st->cap *= 2;
+  }
+  st->item[st->n].node = node;
+  st->item[st->n].mult = mult;
+  st->n++;
+}
+
+static void walk_free(walk_stack *st)
+{
+  if (st->item != st->init) free(st->item);
+}
+
+
+/*
+ * Reduce the AST a to the list of elements {measure,power} in one pass
+ * over the tree, in time linear in its size: every node carries down the
+ * product of the powers above it (the exponents of '^', and -1 for the
+ * right operands of '/'), so a leaf becomes its list element at once,
+ * with no lists to join or to multiply afterwards. The elements come in
+ * the order of the leaves, followed by the list head.
+ *
+ * If free_tree is set, the tree memory is freed on the way. If overflow
+ * is not NULL, *overflow is set to 1 if a power, or the sum of the powers
+ * of a measure in the new elements, is out of the int range (the walk
+ * goes on with the values wrapped around, so that the tree is freed), and
+ * to 0 otherwise.
+ */
+static expr_list *reduce_walk(unit_arena *ar, ast_node *a, expr_list *head,
+                              int free_tree, int *overflow)
+{
+    walk_stack st;
+    walk_item it;
+    num_leaf *numleaf;
+    expr_list *exp = head;
+    meas_pow sum = {{0}};
+    int mult, ovf = 0;
+
+    walk_init(&st);
+    walk_push(&st, a, 1);
+
+    /* The right operands are pushed last, so the list is built back to
+     * front by prepending */
+    while (st.n) {
+        it = st.item[--st.n];
+        a = it.node;
+        switch(a->nodetype) {
+        case 'M':
+            exp = newexpr(ar, ((meas_leaf *) a)->measure, it.mult, exp);
+            ovf |= __builtin_add_overflow(sum.exp[exp->measure], it.mult,
+                                          &sum.exp[exp->measure]);
+            break;
+
+        case '^':
+            numleaf = (num_leaf *) a->r;
+            if (numleaf->nodetype != 'K') {
+                printf("Error: non-numeric power exponent, node type  %c\n",
+                       numleaf->nodetype);
+                break;
+            }
+            ovf |= __builtin_mul_overflow(it.mult, numleaf->number, &mult);
+            walk_push(&st, a->l, mult);
+            if (free_tree) node_free(ar, numleaf);
+            break;
+
+        case '*':
+            walk_push(&st, a->l, it.mult);
+            walk_push(&st, a->r, it.mult);
+            break;
+
+        case '/':
+            walk_push(&st, a->l, it.mult);
+            ovf |= __builtin_sub_overflow(0, it.mult, &mult);
+            walk_push(&st, a->r, mult);
+            break;
+
+        default: printf("reduce(): internal error: bad node '%c'\n",
+                        a->nodetype);
         }
-        exp = concat(expl, expr);
-        
-        break;
+        if (free_tree) node_free(ar, a);
     }
 
-    default: printf("reduce_and_free(): internal error: bad node '%c'\n",
-                    a->nodetype);
-    }
-    
+    walk_free(&st);
+    if (overflow) *overflow = ovf;
     return exp;
-}                   /* End reduce_and_free() */
-
+}
 
 
 /* 
  * Reduce the abstract syntax tree (pointed at by a) to the linked list 
  * (pointed at by head) of elements {measure,power}
  *
+ * The tree memory is freed.
  */
-expr_list *reduce(ast_node *a, expr_list *head) {
-    
-    int pwr, meas;
-    num_leaf *numleaf;
-    meas_leaf *measleaf;
-    expr_list *exp, *expl, *expr;
-    ast_node *nodl, *nodr;
-
-    /*
-     * If the measure expression consists of just a measurement unit 
-     * without operators, no need for the recursive tree reduction.
-     * The AST tree has the only leaf.
-     * 
-     */
-    if (a->nodetype == 'M') {
-        measleaf = (meas_leaf *) a;
-        exp = newexpr(measleaf->measure, 1, head);
-        /* Delete the one-leaf tree */
-        free(a);
-        return exp;
-    }
-    
-    /* 
-     * Dive into recursion 
-     */
-    switch(a->nodetype) {
-    case '^': {
-        numleaf = (num_leaf *) a->r;
-        if (numleaf->nodetype != 'K') {
-            printf("Error: non-numeric power exponent, node type  %c\n",
-                   numleaf->nodetype);
-            return 0;
-        }
-        pwr = numleaf->number;
-
-        nodl = a->l;
-        if (nodl->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodl;
-            exp = newexpr(measleaf->measure, pwr, head);
-        }
-        else {
-            exp = reduce(nodl, head); /* =============== Recurse ======== >> */
-            /* Multiply powers of every list item by pwr */
-            mulpwr(exp, pwr);
-        }
-        break;
-    }
-      
-    case '*': {
-        nodl = a->l;
-        if (nodl->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodl;
-            expl = newexpr(measleaf->measure, 1, head);
-        }
-        else
-            expl = reduce(nodl, head); /* ============== Recurse ======== >> */
-        
-        nodr = a->r;
-        if (nodr->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodr;
-            expr = newexpr(measleaf->measure, 1, head);
-        }
-        else
-            expr = reduce(nodr, head); /* ============== Recurse ======== >> */
-
-        exp = concat(expl, expr);
-        
-        break;
-    }
-      
-    case '/': {
-        nodl = a->l;
-        if (nodl->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodl;
-            expl = newexpr(measleaf->measure, 1, head);
-        }
-        else
-            expl = reduce(nodl, head); /* ============== Recurse ======== >> */
-        
-        nodr = a->r;
-        if (nodr->nodetype == 'M') {
-            measleaf = (meas_leaf *) nodr;
-            expr = newexpr(measleaf->measure, -1, head);
-        }
-        else {
-            expr = reduce(nodr, head); /* ============== Recurse ======== >> */
-            /* Multiply powers of every list item by -1 */
-            mulpwr(expr, -1);
-        }
-        exp = concat(expl, expr);
-        
-        break;
-    }
+expr_list *reduce_and_free(unit_arena *ar, ast_node *a, expr_list *head,
+                           int *overflow) {
+    return reduce_walk(ar, a, head, 1, overflow);
+}
 
-    default: printf("reduce(): internal error: bad node '%c'\n", a->nodetype);
-    }
-    
-    return exp;
-}                    /* End reduce() */
 
+/* 
+ * Reduce the abstract syntax tree (pointed at by a) to the linked list 
+ * (pointed at by head) of elements {measure,power}
+ *
+ */
+expr_list *reduce(unit_arena *ar, ast_node *a, expr_list *head,
+                  int *overflow) {
+    return reduce_walk(ar, a, head, 0, overflow);
+}
 
 
 void
-treefree(ast_node *a)
+treefree(unit_arena *ar, ast_node *a)
 {
-  switch(a->nodetype) {
-
-    /* two subtrees */
-  case '*':
-  case '/':
-    treefree(a->r);
+  walk_stack st;
 
-    /* one subtree */
-  case '^':
-    treefree(a->l);
-
-    /* no subtree */
-  case 'M':
-  case 'K':
-    free(a);
-    break;
+  walk_init(&st);
+  walk_push(&st, a, 1);
+  while (st.n) {
+    a = st.item[--st.n].node;
+    switch(a->nodetype) {
 
-  default: printf("treefree(): internal error: free bad node '%c'\n",
-                  a->nodetype);
+      /* two subtrees */
+    case '*':
+    case '/':
+    case '^':
+      walk_push(&st, a->r, 1);
+      walk_push(&st, a->l, 1);
+      node_free(ar, a);
+      break;
+
+      /* no subtree */
+    case 'M':
+    case 'K':
+      node_free(ar, a);
+      break;
+
+    default: printf("treefree(): internal error: free bad node '%c'\n",
+                    a->nodetype);
+    }
   }
+  walk_free(&st);
 }
 
 
@@ -347,6 +275,41 @@ void mulpwr(expr_list *const exp, int pwr) {
     }
 }
 
+/*
+ * Direct mode of the parser: the semantic actions work on the arrays of
+ * measure powers, so a parse costs a few array operations per operator,
+ * with neither a tree nor a list built.
+ */
+void mpow_meas(meas_pow *mpow, int measure) {
+    int mu;
+    for (mu=0; mu<NMEAS; mu++) mpow->exp[mu] = 0;
+    mpow->exp[measure] = 1;
+}
+
+/* These return -1 if a power overflows an int, else 0 */
+int mpow_mul(meas_pow *mpow, const meas_pow *rhs) {
+    int mu, ovf = 0;
+    for (mu=0; mu<NMEAS; mu++)
+        ovf |= __builtin_add_overflow(mpow->exp[mu], rhs->exp[mu],
+                                      &mpow->exp[mu]);
+    return ovf ? -1 : 0;
+}
+
+int mpow_div(meas_pow *mpow, const meas_pow *rhs) {
+    int mu, ovf = 0;
+    for (mu=0; mu<NMEAS; mu++)
+        ovf |= __builtin_sub_overflow(mpow->exp[mu], rhs->exp[mu],
+                                      &mpow->exp[mu]);
+    return ovf ? -1 : 0;
+}
+
+int mpow_pow(meas_pow *mpow, int pwr) {
+    int mu, ovf = 0;
+    for (mu=0; mu<NMEAS; mu++)
+        ovf |= __builtin_mul_overflow(mpow->exp[mu], pwr, &mpow->exp[mu]);
+    return ovf ? -1 : 0;
+}
+
 /*
  * Join lists expl and expr
  */
@@ -382,6 +345,35 @@ int getmeas(char const *sym) {
 }
 
 
+/*
+ * Integer power, the same as (int) pow(base, pwr), but with no floating
+ * point: negative powers give 0, except for the bases 1 and -1.
+ * The caller rejects base 0 with pwr < 0.
+ * Sets *val and returns 0, or returns -1 if the power overflows int.
+ * It works by squaring; a square is only taken while a higher bit of pwr
+ * is left, so it is a factor of the result, and overflows only if the
+ * result does.
+ */
+int ipow(int base, int pwr, int *val) {
+
+    int res = 1;
+    if (pwr < 0) {
+        if (base == 1) *val = 1;
+        else if (base == -1) *val = (pwr % 2) ? -1 : 1;
+        else *val = 0;
+        return 0;
+    }
+    for (;;) {
+        if ((pwr & 1) && __builtin_mul_overflow(res, base, &res)) return -1;
+        pwr >>= 1;
+        if (!pwr) break;
+        if (__builtin_mul_overflow(base, base, &base)) return -1;
+    }
+    *val = res;
+    return 0;
+}
+
+
 void print_list(expr_list *const expr) {
     
     expr_list *ep = expr;
@@ -396,13 +388,13 @@ void print_list(expr_list *const expr) {
 
 /* ------------------------------------------------------------------------ */
 
-void free_list(expr_list *expr) {
+void free_list(unit_arena *ar, expr_list *expr) {
     
     expr_list *ep_next, *ep = expr;
     int mu;
     while (ep) {        
         ep_next = ep->next;
-        free(ep);
+        node_free(ar, ep);
         ep = ep_next;
     }
 }
@@ -410,36 +402,44 @@ void free_list(expr_list *expr) {
 
 void print_tree(ast_node *a) {
 
-    switch(a->nodetype) {
-        /* two subtrees */
-    case '*':
-    case '/':
-    case '^':
-        printf("'%c' ==> ", a->nodetype);
-        print_tree(a->r);
-        print_tree(a->l);
-        break;
-
-        /* no subtree */
-    case 'K': {
-        num_leaf *nl = (num_leaf *)a;
-        printf("'%d'\n", nl->number);
-        break;
-    }
-    case 'M': {
-        meas_leaf *ml = (meas_leaf *)a;
-        int mu = ml->measure;
-        printf("'%s'\n", meas_tab[mu]);
-        break;
-    }
-    default: printf("print_tree(): internal error: free bad node '%c'\n",
-                    a->nodetype);
+    walk_stack st;
+
+    /* Each operator, then its right and its left subtree */
+    walk_init(&st);
+    walk_push(&st, a, 1);
+    while (st.n) {
+        a = st.item[--st.n].node;
+        switch(a->nodetype) {
+            /* two subtrees */
+        case '*':
+        case '/':
+        case '^':
+            printf("'%c' ==> ", a->nodetype);
+            walk_push(&st, a->l, 1);
+            walk_push(&st, a->r, 1);
+            break;
+
+            /* no subtree */
+        case 'K': {
+            num_leaf *nl = (num_leaf *)a;
+            printf("'%d'\n", nl->number);
+            break;
+        }
+        case 'M': {
+            meas_leaf *ml = (meas_leaf *)a;
+            int mu = ml->measure;
+            printf("'%s'\n", meas_tab[mu]);
+            break;
+        }
+        default: printf("print_tree(): internal error: free bad node '%c'\n",
+                        a->nodetype);
+        }
     }
-    return;
+    walk_free(&st);
 }
 
 
-void yyerror(expr_list **explst, const char *s, ...)
+void yyerror(void *scanner, parse_ctx *ctx, const char *s, ...)
 {
   va_list ap;
   va_start(ap, s);
@@ -447,6 +447,7 @@ void yyerror(expr_list **explst, const char *s, ...)
   fprintf(stderr, "Error: ");
   vfprintf(stderr, s, ap);
   fprintf(stderr, "\n");
+  va_end(ap);
 }
 
 
@@ -475,7 +476,8 @@ void explst_to_arr(expr_list *explst, meas_pow *mpow) {
  * Convert measurement expression from list form into array of measure powers.
  * Free the list.
  */
-void explst_to_arr_and_free(expr_list *explst, meas_pow *mpow) {
+void explst_to_arr_and_free(unit_arena *ar, expr_list *explst,
+                            meas_pow *mpow) {
 
     expr_list *ep_next, *ep = explst;
     int mu, pw;
@@ -488,8 +490,85 @@ void explst_to_arr_and_free(expr_list *explst, meas_pow *mpow) {
         mpow->exp[mu] += pw;
         
         ep_next = ep->next;
-        free(ep);
+        node_free(ar, ep);
         ep = ep_next;
     }
 }
 
+
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Bump allocator for the nodes of a parse. The memory is taken from big
+ * blocks and is never freed piecemeal; arena_reset() releases everything
+ * at once, so a long-lived arena serves parse after parse without
+ * touching the heap.
+ */
+
+/* Block header size, rounded up to keep the allocations aligned */
+#define ARENA_ALIGN 16
+#define ARENA_HDR ((sizeof(arena_block) + ARENA_ALIGN - 1) & \
+                   ~(size_t)(ARENA_ALIGN - 1))
+
+void arena_init(unit_arena *ar) {
+    ar->head = NULL;
+}
+
+void *arena_alloc(unit_arena *ar, size_t size) {
+
+    arena_block *blk = ar->head;
+    size_t bsize;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (!blk || blk->used + size > blk->size) {
+        /* New block, at least twice as big as the current one */
+        bsize = ARENA_BLOCK_SIZE;
+        if (blk && 2*blk->size > bsize) bsize = 2*blk->size;
+        if (size > bsize) bsize = size;
+        blk = (arena_block *) malloc(ARENA_HDR + bsize);
+        if (!blk) return NULL;
+        blk->next = ar->head;
+        blk->size = bsize;
+        blk->used = 0;
+        ar->head = blk;
+    }
+
+    void *p = (char *) blk + ARENA_HDR + blk->used;
+    blk->used += size;
+    return p;
+}
+
+/*
+ * Release all the allocations at once. If the arena grew past one block,
+ * the blocks are replaced with a single one holding all of them, so that
+ * the next parse of the same size does not need the heap.
+ */
+void arena_reset(unit_arena *ar) {
+
+    arena_block *blk;
+    size_t total = 0;
+
+    if (!ar->head) return;
+    if (ar->head->next) {
+        for (blk = ar->head; blk; blk = blk->next) total += blk->size;
+        arena_free(ar);
+        blk = (arena_block *) malloc(ARENA_HDR + total);
+        if (!blk) return;
+        blk->next = NULL;
+        blk->size = total;
+        ar->head = blk;
+    }
+    ar->head->used = 0;
+}
+
+void arena_free(unit_arena *ar) {
+
+    arena_block *blk_next, *blk = ar->head;
+    while (blk) {
+        blk_next = blk->next;
+        free(blk);
+        blk = blk_next;
+    }
+    ar->head = NULL;
+}
@@ -0,0 +1,225 @@
+/*
+ * Demo and exercise of the MHO_Unit class
+ */
+#include <cstdio>
+#include <array>
+#include <iostream>
+#include "MHO_Unit.hh"
+#include "MHO_StaticUnit.hh"
+#include "MHO_UnitRegistry.hh"
+#include "MHO_UnitArray.hh"
+#include "MHO_UnitConversion.hh"
+#include "MHO_UnitDimension.hh"
+
+
+//
+// =================  M A I N  ======================
+//
+
+using namespace hops;
+using namespace hops::unit_literals;
+
+int main(void) {
+
+    char const accel_expr[] = "m/s^2";
+    char const force_expr[] = "kg*m/s^2";
+    char const energy_expr[] = "kg*m^2/s^2";
+    
+    char const meas_expr1[] = "m * ((kg^2*s^-3/A)^-5 * K^5/cd/" \
+        "(mol*Hz)^3*s)^2 * rad * Jy^(7 + 2*(4 - 6))";
+    
+    char const meas_expr2[] = " A*kg*(m^-1*s^-2)^3";
+
+    char const meas_expr3[] = " A * kg *(m^-1*s^-2)^3  ";
+
+    printf("MHO_Unit Declarations:\n");
+    printf("\nMHO_Unit acc: '%s'\n", accel_expr);
+    MHO_Unit acc(accel_expr);
+    
+    printf("\nMHO_Unit F: '%s'\n", force_expr);
+    MHO_Unit F(force_expr);
+    
+    printf("\nMHO_Unit E: '%s'\n", energy_expr);
+    MHO_Unit E;                E.SetUnitString(energy_expr);
+    
+    printf("\nMHO_Unit mass: '%s'\n", "kg");
+    MHO_Unit mass;          mass.SetUnitString("kg");
+
+    MHO_Unit u0;
+    
+    printf("\nMHO_Unit u1: '%s'\n", meas_expr1);
+    MHO_Unit u1(meas_expr1);
+    
+    printf("\nMHO_Unit u2: '%s'\n", meas_expr2);
+    MHO_Unit u2(meas_expr2);
+
+    printf("\nMHO_Unit u3: '%s'\n", meas_expr3);
+    MHO_Unit u3(meas_expr3);
+    
+    printf("\nMHO_Unit u4: '%s'\n", meas_expr2);
+    MHO_Unit u4(meas_expr2);
+    
+
+    std::cout << "Source measure expression 1:\n";
+    std::cout << meas_expr1 << std::endl << std::endl;
+
+    std::cout << "MHO_Unit u1(meas_expr1); u1.GetUnitString():\n";
+    std::cout << u1.GetUnitString() << std::endl << std::endl;
+    std::cout << "u1 exponents: ";
+    std::array<int, NMEAS> aex = u1.GetUnitExp();
+    for (int mu=0; mu<NMEAS; mu++)
+        std::cout << aex[mu] << " ";
+    std::cout << std::endl << std::endl;
+    
+    std::cout << "u0.GetUnitString() -- empty expression.\n";
+    std::cout << u0.GetUnitString() << std::endl;
+    
+    std::cout << "Source measure expression 2:\n";
+    std::cout << meas_expr2 << std::endl << std::endl << std::endl;
+    
+    std::cout << "MHO_Unit u1(meas_expr2); u2.GetUnitString():\n";
+    std::cout << u2.GetUnitString() << std::endl << std::endl;
+
+    std::cout << "u1/u2 = " << std::endl;
+    std::cout << (u1/u2).GetUnitString() << std::endl << std::endl;
+    
+    std::cout << "u2/u1) = " << std::endl;
+    std::cout << (u2/u1).GetUnitString() << std::endl << std::endl;
+    
+    std::cout << "u1*u2 = " << std::endl;
+    std::cout << (u1*u2).GetUnitString() << std::endl << std::endl;
+
+    
+    std::cout << "u2 == u3 = ";
+    std::cout << (u2 == u3 ? "True":"False") << std::endl << std::endl;
+    
+    std::cout << "u2 != u3 = ";
+    std::cout << (u2 != u3 ? "True":"False") << std::endl << std::endl;
+    
+    std::cout << "u1^(-1) = " << std::endl;
+    std::cout << (u1^(-1)).GetUnitString() << std::endl << std::endl;
+
+    u1.Invert();
+    std::cout << "u1.Invert(): " << std::endl;
+    std::cout << u1.GetUnitString() << std::endl << std::endl;
+
+    u1.RaiseToPower(-1);
+    std::cout << "u1.RaiseToPower(-1): " << std::endl;
+    std::cout << u1.GetUnitString() << std::endl
+              << std::endl;
+    
+    std::cout << "F = m*a: (mass * acc).GetUnitString():" << std::endl;
+    std::cout << (mass * acc).GetUnitString() << std::endl << std::endl;
+
+    std::cout << "E/F = s: (E / F).GetUnitString():" << std::endl;
+    std::cout << (E / F).GetUnitString() << std::endl << std::endl;
+
+    u0 = mass*acc; // u0 is F = m * a.
+    std::cout << "F = m*a; : (mass * acc).GetUnitString():" << std::endl;
+    std::cout << u0.GetUnitString() << std::endl << std::endl;
+
+    F ^= -3;
+    std::cout << "F ^= -3;  : F.GetUnitString():" << std::endl;
+    std::cout << F.GetUnitString() << std::endl << std::endl;
+
+    u0 = u4 * "kg^-1 * (m^-1 * s^-2)^(-3) / m^2";
+    std::cout << "u4 = ";
+    std::cout << u4.GetUnitString() << std::endl;
+    std::cout << "u0 = u4 * \"kg^-1 * (m^-1 * s^-2)^(-3) / m^2\";" << std::endl;
+    std::cout << "u0 = ";
+    std::cout << u0.GetUnitString() << std::endl << std::endl;
+
+    u0 = u4 * "kg^-1 * (m^-1 * s^-2)^(-3) / m^2"_unit;
+    std::cout << "u0 = u4 * \"kg^-1 * (m^-1 * s^-2)^(-3) / m^2\"_unit;"
+              << std::endl;
+    std::cout << "u0 = ";
+    std::cout << u0.GetUnitString() << std::endl << std::endl;
+
+    u0 = "kg" * acc; // u0 is F = m * a.
+    std::cout << "acc = ";
+    std::cout << acc.GetUnitString() << std::endl;
+    std::cout << "u0 = \"kg\" * acc = ";
+    std::cout << u0.GetUnitString() << std::endl;
+    std::cout << "u0 exponents: ";
+    aex = u0.GetUnitExp();
+    for (int mu=0; mu<NMEAS; mu++)
+        std::cout << aex[mu] << " ";
+    std::cout << std::endl << std::endl;
+
+   
+    u0 = mass * "m/s^2"; // u0 is F = m * a.acc
+    std::cout << "mass = ";
+    std::cout << mass.GetUnitString() << std::endl;
+    std::cout << "u0 = mass * \"m/s^2\" = ";
+    std::cout << u0.GetUnitString() << std::endl << std::endl;
+
+    u0 = u4 / "kg * (m^-1 * s^-2)^3 * m^2";
+    std::cout << "u4 = ";
+    std::cout << u4.GetUnitString() << std::endl;
+    std::cout << "u0 = u4 / \"kg * (m^-1 * s^-2)^3 * m^2\";" << std::endl;
+    std::cout << "u0 = ";
+    std::cout << u0.GetUnitString() << std::endl << std::endl;
+
+    u0 = "kg * (m^-1 * s^-2)^3" / acc;
+    std::cout << "acc = ";
+    std::cout << acc.GetUnitString() << std::endl;
+    std::cout << "u0 = ""kg * (m^-1 * s^-2)^3"" / acc;" << std::endl;
+    std::cout << "u0 = ";
+    std::cout << u0.GetUnitString() << std::endl << std::endl;
+
+    MHO_StaticUnitOf<"kg"> smass;
+    MHO_StaticUnitOf<"m/s^2"> sacc;
+    MHO_StaticUnitOf<"kg*m/s^2"> sF = smass * sacc; // Checked at compile time
+    std::cout << "Static units: sF = smass * sacc = ";
+    std::cout << sF.GetUnitString() << std::endl;
+    std::cout << "sF ^ MHO_Pow<-3>() = ";
+    std::cout << (sF ^ MHO_Pow<-3>()).GetUnitString() << std::endl;
+    std::cout << "MHO_StaticUnitOf<\"kg*m/s^2\">::Matches(mass * acc) = ";
+    std::cout << (decltype(sF)::Matches(mass * acc) ? "True":"False")
+              << std::endl << std::endl;
+
+    MHO_UnitRegistry& registry = MHO_UnitRegistry::GetInstance();
+    registry.Register("N", "kg*m/s^2");
+    registry.Register("J", "N*m");
+    MHO_Unit energy("J/s");
+    std::cout << "Registered units N = kg*m/s^2 and J = N*m" << std::endl;
+    std::cout << "MHO_Unit energy(\"J/s\") = ";
+    std::cout << energy.GetUnitString() << std::endl << std::endl;
+
+    auto res = MHO_Unit::TryParse("kg*m/ss^2");
+    std::cout << "MHO_Unit::TryParse(\"kg*m/ss^2\"): ";
+    if (res)
+        std::cout << res->GetUnitString() << std::endl << std::endl;
+    else
+        std::cout << res.error().What() << " at offset "
+                  << res.error().fOffset << std::endl << std::endl;
+
+    double freq[3] = {1.4e3, 4.8e3, 8.4e3};  // MHz
+    MHO_UnitConversion::Convert("MHz", "GHz", freq);
+    std::cout << "MHO_UnitConversion(\"deg\", \"rad\").GetFactor() = ";
+    std::cout << MHO_UnitConversion("deg", "rad").GetFactor() << std::endl;
+    std::cout << "Convert(\"MHz\", \"GHz\"): 1400 4800 8400 MHz -> ";
+    std::cout << freq[0] << " " << freq[1] << " " << freq[2] << " GHz";
+    std::cout << std::endl << std::endl;
+
+    MHO_Unit chan[3] = {MHO_Unit("Jy"), MHO_Unit("Jy"), MHO_Unit("Jy/s")};
+    MHO_UnitArray chans(chan);
+    chans *= MHO_UnitArray(3, MHO_Unit("s"));
+    std::cout << "MHO_UnitArray {Jy, Jy, Jy/s} * s = {";
+    for (std::size_t i=0; i<chans.GetSize(); i++)
+        std::cout << (i ? ", " : "") << chans.Get(i).GetUnitString();
+    std::cout << "}, AllCompatible(Jy*s) = ";
+    std::cout << (chans.AllCompatible(MHO_Unit("Jy*s")) ? "True":"False");
+    std::cout << std::endl << std::endl;
+
+    MHO_Unit hz("Hz"), jy("Jy*Hz^-1");
+    std::cout << "Compatible(Hz, s^-1) = ";
+    std::cout << (MHO_UnitDimension::Compatible(hz, MHO_Unit("s^-1")) ?
+                  "True" : "False") << std::endl;
+    std::cout << "Project(Jy*Hz^-1) = ";
+    std::cout << MHO_UnitDimension::Project(jy).GetUnitString();
+    std::cout << ", GetScale() = " << MHO_UnitDimension::GetScale(jy);
+    std::cout << std::endl << std::endl;
+    
+    return 0;            
+}